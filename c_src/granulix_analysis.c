@@ -0,0 +1,329 @@
+#include <erl_nif.h>
+#include <math.h>
+#include <string.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+#include "granulix_oversample.h"
+
+/* Level metering and spectrum analysis directly on the frame binaries.
+
+   levels/1 is stateless and returns {peak, rms, dc} for one binary in a
+   single pass. The meter resource adds true peak, measured on a 4x
+   oversampled signal with the half-band stages from granulix_oversample.h
+   which need the history between periods. The spectrum resource keeps the
+   last size frames and returns the Hann windowed FFT magnitudes as a
+   binary of size / 2 + 1 floats.
+*/
+
+#define FRAME_TYPE float
+#define FRAME_SIZE sizeof(FRAME_TYPE)
+#define TRUE_PEAK_OVERSAMPLE 4
+
+static ErlNifResourceType* meter_type;
+static ErlNifResourceType* spectrum_type;
+
+typedef struct
+{
+  Oversample os;
+} Meter;
+
+typedef struct
+{
+  unsigned int size;  // Power of two
+  unsigned int iwrite;
+  float norm;         // Scales magnitudes to amplitudes
+  float * window;
+  float * hist;       // Circular, size frames
+  float * re, * im;
+  float * cosv, * sinv;
+  unsigned int * rev;
+  float data[];
+} Spectrum;
+
+/* ----------------------------------------------------------------------- */
+
+static inline float peak_of(const float * x, unsigned int n) {
+  unsigned int i = 0;
+  float peak = 0.f;
+#ifdef __AVX__
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 mpeak = _mm256_setzero_ps();
+  for(; i + 8 <= n; i += 8) {
+    mpeak = _mm256_max_ps(mpeak, _mm256_and_ps(_mm256_loadu_ps(x + i), abs_mask));
+  }
+  __m128 m = _mm_max_ps(_mm256_castps256_ps128(mpeak), _mm256_extractf128_ps(mpeak, 1));
+  m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 0x55));
+  peak = _mm_cvtss_f32(m);
+#endif
+  for(; i < n; i++) {
+    float a = fabsf(x[i]);
+    peak = (a > peak)? a:peak;
+  }
+  return peak;
+}
+
+// Peak, sum and sum of squares in one pass
+static inline void levels_of(const float * x, unsigned int n,
+                             float * peak, double * sum, double * sumsq) {
+  unsigned int i = 0;
+  float p = 0.f;
+  double s = 0.0, ss = 0.0;
+#ifdef __AVX__
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 mpeak = _mm256_setzero_ps();
+  __m256 msum = _mm256_setzero_ps();
+  __m256 msumsq = _mm256_setzero_ps();
+  float tmp[8];
+  for(; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    mpeak = _mm256_max_ps(mpeak, _mm256_and_ps(v, abs_mask));
+    msum = _mm256_add_ps(msum, v);
+    msumsq = _mm256_add_ps(msumsq, _mm256_mul_ps(v, v));
+  }
+  _mm256_storeu_ps(tmp, mpeak);
+  for(int k = 0; k < 8; k++) p = (tmp[k] > p)? tmp[k]:p;
+  _mm256_storeu_ps(tmp, msum);
+  for(int k = 0; k < 8; k++) s += tmp[k];
+  _mm256_storeu_ps(tmp, msumsq);
+  for(int k = 0; k < 8; k++) ss += tmp[k];
+#endif
+  for(; i < n; i++) {
+    float a = fabsf(x[i]);
+    p = (a > p)? a:p;
+    s += x[i];
+    ss += x[i] * x[i];
+  }
+  *peak = p;
+  *sum = s;
+  *sumsq = ss;
+}
+
+static ERL_NIF_TERM levels(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  ErlNifBinary xbin;
+  float peak;
+  double sum, sumsq;
+
+  if(!enif_inspect_binary(env, argv[0], &xbin)) {
+    return enif_make_badarg(env);
+  }
+  unsigned int n = xbin.size / FRAME_SIZE;
+  levels_of((FRAME_TYPE *) xbin.data, n, &peak, &sum, &sumsq);
+  n = (n == 0)? 1:n;
+  return enif_make_tuple3(env,
+                          enif_make_double(env, peak),
+                          enif_make_double(env, sqrt(sumsq / n)),
+                          enif_make_double(env, sum / n));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ERL_NIF_TERM meter_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Meter * unit  = enif_alloc_resource(meter_type, sizeof(Meter));
+  oversample_init(&unit->os, TRUE_PEAK_OVERSAMPLE);
+  ERL_NIF_TERM term = enif_make_resource(env, unit);
+  enif_release_resource(unit);
+  return term;
+}
+
+static ERL_NIF_TERM meter_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Meter * unit;
+  ErlNifBinary xbin;
+  float peak;
+  double sum, sumsq;
+
+  if (!(enif_get_resource(env, argv[0], meter_type, (void**) &unit) &&
+        enif_inspect_binary(env, argv[1], &xbin))) {
+    return enif_make_badarg(env);
+  }
+
+  unsigned int n = xbin.size / FRAME_SIZE;
+  float * x = (FRAME_TYPE *) xbin.data;
+  levels_of(x, n, &peak, &sum, &sumsq);
+
+  float * work = (float *) enif_alloc(oversample_work_size(&unit->os, n) * FRAME_SIZE);
+  oversample_up(&unit->os, x, n, work);
+  float true_peak = peak_of(work, n * unit->os.factor);
+  enif_free(work);
+
+  n = (n == 0)? 1:n;
+  return enif_make_tuple4(env,
+                          enif_make_double(env, peak),
+                          enif_make_double(env, sqrt(sumsq / n)),
+                          enif_make_double(env, (true_peak > peak)? true_peak:peak),
+                          enif_make_double(env, sum / n));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void fft(Spectrum * unit) {
+  unsigned int n = unit->size;
+  float * re = unit->re, * im = unit->im;
+
+  for(unsigned int i = 0; i < n; i++) {
+    unsigned int j = unit->rev[i];
+    if(j > i) {
+      float t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+  for(unsigned int len = 2; len <= n; len <<= 1) {
+    unsigned int half = len >> 1;
+    unsigned int tstep = n / len;
+    for(unsigned int i = 0; i < n; i += len) {
+      for(unsigned int k = 0; k < half; k++) {
+        float wr = unit->cosv[k * tstep], wi = unit->sinv[k * tstep];
+        unsigned int a = i + k, b = a + half;
+        float tr = re[b] * wr - im[b] * wi;
+        float ti = re[b] * wi + im[b] * wr;
+        re[b] = re[a] - tr; im[b] = im[a] - ti;
+        re[a] += tr; im[a] += ti;
+      }
+    }
+  }
+}
+
+static ERL_NIF_TERM spectrum_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  unsigned int size;
+  if (!(enif_get_uint(env, argv[0], &size) &&
+        size >= 16 && size <= 65536 && (size & (size - 1)) == 0)) {
+    return enif_make_badarg(env);
+  }
+
+  // window, hist, re, im: size each, cosv, sinv: size / 2, rev: size
+  Spectrum * unit = enif_alloc_resource(spectrum_type,
+                                        sizeof(Spectrum) + 6 * size * sizeof(float));
+  unit->size = size;
+  unit->iwrite = 0;
+  unit->window = unit->data;
+  unit->hist = unit->window + size;
+  unit->re = unit->hist + size;
+  unit->im = unit->re + size;
+  unit->cosv = unit->im + size;
+  unit->sinv = unit->cosv + size / 2;
+  unit->rev = (unsigned int *) (unit->sinv + size / 2);
+  memset(unit->hist, 0, size * sizeof(float));
+
+  double wsum = 0.0;
+  for(unsigned int i = 0; i < size; i++) {
+    unit->window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / size);
+    wsum += unit->window[i];
+  }
+  unit->norm = 2.0 / wsum;
+  for(unsigned int k = 0; k < size / 2; k++) {
+    unit->cosv[k] = cos(2.0 * M_PI * k / size);
+    unit->sinv[k] = -sin(2.0 * M_PI * k / size);
+  }
+  unsigned int bits = 0;
+  while((1u << bits) < size) bits++;
+  for(unsigned int i = 0; i < size; i++) {
+    unsigned int r = 0;
+    for(unsigned int b = 0; b < bits; b++) {
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    unit->rev[i] = r;
+  }
+
+  ERL_NIF_TERM term = enif_make_resource(env, unit);
+  enif_release_resource(unit);
+  return term;
+}
+
+/* Adds the frames to the history and returns the magnitudes of the
+   last size frames. */
+static ERL_NIF_TERM spectrum_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Spectrum * unit;
+  ErlNifBinary xbin;
+  ERL_NIF_TERM out_term;
+
+  if (!(enif_get_resource(env, argv[0], spectrum_type, (void**) &unit) &&
+        enif_inspect_binary(env, argv[1], &xbin))) {
+    return enif_make_badarg(env);
+  }
+
+  unsigned int size = unit->size;
+  unsigned int mask = size - 1;
+  unsigned int n = xbin.size / FRAME_SIZE;
+  float * x = (FRAME_TYPE *) xbin.data;
+  // Only the last size frames matter
+  unsigned int skip = (n > size)? n - size:0;
+  unsigned int iwrite = unit->iwrite;
+  for(unsigned int i = skip; i < n; i++) {
+    unit->hist[iwrite] = x[i];
+    iwrite = (iwrite + 1) & mask;
+  }
+  unit->iwrite = iwrite;
+
+  // Oldest frame first
+  unsigned int first = size - iwrite;
+  memcpy(unit->re, unit->hist + iwrite, first * sizeof(float));
+  memcpy(unit->re + first, unit->hist, iwrite * sizeof(float));
+#ifdef __AVX__
+  for(unsigned int i = 0; i < size; i += 8) {
+    _mm256_storeu_ps(unit->re + i, _mm256_mul_ps(_mm256_loadu_ps(unit->re + i),
+                                                 _mm256_loadu_ps(unit->window + i)));
+  }
+#else
+  for(unsigned int i = 0; i < size; i++) {
+    unit->re[i] *= unit->window[i];
+  }
+#endif
+  memset(unit->im, 0, size * sizeof(float));
+  fft(unit);
+
+  unsigned int bins = size / 2 + 1;
+  float * out = (float *) enif_make_new_binary(env, bins * FRAME_SIZE, &out_term);
+  float norm = unit->norm;
+  for(unsigned int k = 0; k < bins; k++) {
+    out[k] = sqrtf(unit->re[k] * unit->re[k] + unit->im[k] * unit->im[k]) * norm;
+  }
+  // DC and Nyquist are not doubled
+  out[0] *= 0.5f;
+  out[bins - 1] *= 0.5f;
+  return out_term;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ErlNifFunc nif_funcs[] = {
+  {"levels", 1, levels},
+  {"meter_ctor", 0, meter_ctor},
+  {"meter_next", 2, meter_next},
+  {"spectrum_ctor", 1, spectrum_ctor},
+  {"spectrum_next", 2, spectrum_next}
+};
+
+static int open_analysis_resource_types(ErlNifEnv* env)
+{
+  const char* mod = "Elixir.Granulix.Analysis";
+  int flags = ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER;
+  meter_type =
+    enif_open_resource_type(env, mod, "meter",
+                            NULL, flags, NULL);
+  spectrum_type =
+    enif_open_resource_type(env, mod, "spectrum",
+                            NULL, flags, NULL);
+  return ((meter_type == NULL || spectrum_type == NULL) ? -1:0);
+}
+
+static int load(ErlNifEnv* caller_env, void** priv_data, ERL_NIF_TERM load_info)
+{
+  oversample_init_coefs();
+  return open_analysis_resource_types(caller_env);
+}
+
+static int upgrade(ErlNifEnv* caller_env, void** priv_data, void** old_priv_data,
+		   ERL_NIF_TERM load_info)
+{
+  oversample_init_coefs();
+  return open_analysis_resource_types(caller_env);
+}
+
+
+ERL_NIF_INIT(Elixir.Granulix.Analysis, nif_funcs, load, NULL, upgrade, NULL);
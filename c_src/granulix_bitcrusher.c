@@ -1,6 +1,7 @@
 #include <erl_nif.h>
 #include <math.h>
 #include <string.h>
+#include "granulix_oversample.h"
 
 /* Code translated from Elixir - Synthex.Filter.Bitcrusher:
 https://github.com/bitgamma/synthex/blob/master/lib/synthex/filter/bitcrusher.ex
@@ -16,12 +17,22 @@ typedef struct
      double bits; double normalized_frequency;
   */
   float last, phaser;
+  Oversample os;
 } Bitcrusher;
 
 
 static ERL_NIF_TERM bitcrusher_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
+  unsigned int factor;
+  if (!enif_get_uint(env, argv[0], &factor)){
+    return enif_make_badarg(env);
+  }
+
   Bitcrusher * unit  = enif_alloc_resource(bitcrusher_type, sizeof(Bitcrusher));
+  if (!oversample_init(&unit->os, factor)) {
+    enif_release_resource(unit);
+    return enif_make_badarg(env);
+  }
   unit->last = unit->phaser = 0.0;
   ERL_NIF_TERM term = enif_make_resource(env, unit);
   enif_release_resource(unit);
@@ -64,6 +75,17 @@ static ERL_NIF_TERM bitcrusher_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM
   in = (float * ) in_bin.data;
   out = (float *) enif_make_new_binary(env, in_bin.size, &out_term);
 
+  // When oversampling, run the quantizer in place on the work buffer
+  float * work = NULL;
+  float * src = in, * dst = out;
+  if (unit->os.stages > 0) {
+    work = (float *) enif_alloc(oversample_work_size(&unit->os, no_of_frames) * sizeof(float));
+    oversample_up(&unit->os, in, no_of_frames, work);
+    src = dst = work;
+    no_of_frames *= unit->os.factor;
+    normalized_frequency /= unit->os.factor;
+  }
+
   last = unit->last;
   phaser = unit->phaser;
   float step =  powf(0.5, (float) bits);
@@ -71,13 +93,18 @@ static ERL_NIF_TERM bitcrusher_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM
   sample = output =  0.0;
 
   for (int i = 0; i < no_of_frames; i++) {
-    sample = in[i];
+    sample = src[i];
     phaser += normalized_frequency;
     if (phaser >= 1.0) {
       last = step * floor(sample / step + 0.5);
       phaser -= 1.0;
     }  
-    out[i] = last;
+    dst[i] = last;
+  }
+
+  if (work) {
+    oversample_down(&unit->os, work, no_of_frames / unit->os.factor, out);
+    enif_free(work);
   }
 
   // Variables were updated need to be stored back into the state
@@ -90,7 +117,7 @@ static ERL_NIF_TERM bitcrusher_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM
 /* ----------------------------------------------------------------------- */
 
 static ErlNifFunc nif_funcs[] = {
-  {"bitcrusher_ctor", 0, bitcrusher_ctor},
+  {"bitcrusher_ctor", 1, bitcrusher_ctor},
   {"bitcrusher_next", 4, bitcrusher_next}
 };
 
@@ -107,12 +134,14 @@ static int open_bitcrusher_resource_type(ErlNifEnv* env)
 
 static int load(ErlNifEnv* caller_env, void** priv_data, ERL_NIF_TERM load_info)
 {
+  oversample_init_coefs();
   return open_bitcrusher_resource_type(caller_env);
 }
 
 static int upgrade(ErlNifEnv* caller_env, void** priv_data, void** old_priv_data,
 		   ERL_NIF_TERM load_info)
 {
+  oversample_init_coefs();
   return open_bitcrusher_resource_type(caller_env);
 }
 
@@ -0,0 +1,267 @@
+#include <erl_nif.h>
+#include <math.h>
+#include <string.h>
+
+/* Delay lines in the spirit of the SuperCollider DelayN/L/C, CombN/L/C
+   and AllpassN/L/C UGens. The history is kept in a power of two sized
+   circular buffer allocated together with the resource, so reading and
+   writing never copies old frames, and wrapping is a single mask.
+*/
+
+// Largest buffer in frames, a delay of 1000 s at 192 kHz still fits
+#define MAX_DELAY_SAMPLES (1u << 28)
+
+static ErlNifResourceType* delay_type;
+
+typedef enum
+  {
+    DELAY,
+    COMB,
+    ALLPASS
+  } DelayType;
+
+typedef enum
+  {
+    NONE,
+    LINEAR,
+    CUBIC
+  } Interpolation;
+
+typedef struct
+{
+  unsigned int rate;
+  DelayType type;
+  Interpolation interp;
+  float max_delay;     // In samples
+  unsigned int mask;   // Buffer size - 1
+  unsigned int iwrite; // Write position
+  float buf[];         // Circular buffer, mask + 1 frames
+} Delay;
+
+static unsigned int next_pow2(unsigned int n) {
+  unsigned int size = 1;
+  while(size < n) {
+    size <<= 1;
+  }
+  return size;
+}
+
+/* Read the buffer delay samples behind the write position.
+   delay shall be between 1 and max_delay, cubic needs two more samples
+   of history and one ahead so it is kept at least 2 behind.
+*/
+static inline float delay_read(const float * buf, unsigned int mask,
+                               unsigned int iwrite, float delay,
+                               Interpolation interp) {
+  int idelay = (int) delay;
+  float frac = delay - idelay;
+  unsigned int irdpos = iwrite - idelay;
+  float d0, d1, d2, d3;
+
+  switch(interp) {
+  case NONE:
+    return buf[irdpos & mask];
+  case LINEAR:
+    d1 = buf[irdpos & mask];
+    d2 = buf[(irdpos - 1) & mask];
+    return d1 + frac * (d2 - d1);
+  default:
+    // Hermite 4 point, 3rd order
+    d0 = buf[(irdpos + 1) & mask];
+    d1 = buf[irdpos & mask];
+    d2 = buf[(irdpos - 1) & mask];
+    d3 = buf[(irdpos - 2) & mask];
+    float c1 = 0.5f * (d2 - d0);
+    float c2 = d0 - 2.5f * d1 + 2.f * d2 - 0.5f * d3;
+    float c3 = 0.5f * (d3 - d0) + 1.5f * (d1 - d2);
+    return ((c3 * frac + c2) * frac + c1) * frac + d1;
+  }
+}
+
+static inline float clip_delay(float delay, float min, float max) {
+  return (delay < min)? min:((delay > max)? max:delay);
+}
+
+/* The interpolation is passed as a constant from the switch in
+   delay_next so that each variant gets its own specialized loop. */
+static inline void delay_loop(Delay * unit, const float * in, float * out,
+                              unsigned int no_of_frames,
+                              const float * delay_in, float delay,
+                              float feedback, Interpolation interp) {
+  float * buf = unit->buf;
+  unsigned int mask = unit->mask;
+  unsigned int iwrite = unit->iwrite;
+  float min_delay = (interp == CUBIC)? 2.f:1.f;
+  float max_delay = unit->max_delay;
+  float rate = unit->rate;
+  DelayType type = unit->type;
+  float value, dwr;
+
+  delay = clip_delay(delay * rate, min_delay, max_delay);
+
+  for(unsigned int i = 0; i < no_of_frames; i++) {
+    if(delay_in) {
+      delay = clip_delay(delay_in[i] * rate, min_delay, max_delay);
+    }
+    value = delay_read(buf, mask, iwrite, delay, interp);
+    switch(type) {
+    case DELAY:
+      buf[iwrite & mask] = in[i];
+      out[i] = value;
+      break;
+    case COMB:
+      buf[iwrite & mask] = in[i] + feedback * value;
+      out[i] = value;
+      break;
+    case ALLPASS:
+      dwr = in[i] + feedback * value;
+      buf[iwrite & mask] = dwr;
+      out[i] = value - feedback * dwr;
+      break;
+    }
+    iwrite++;
+  }
+  unit->iwrite = iwrite & mask;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ERL_NIF_TERM delay_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  unsigned int rate;
+  double max_delay;
+  char type[12];
+  char interp[12];
+
+  if (!(enif_get_uint(env, argv[0], &rate) &&
+        enif_get_double(env, argv[1], &max_delay) &&
+        max_delay > 0.0 &&
+        max_delay * rate <= MAX_DELAY_SAMPLES - 4 &&
+        enif_get_atom(env, argv[2], type, 12, ERL_NIF_LATIN1) &&
+        enif_get_atom(env, argv[3], interp, 12, ERL_NIF_LATIN1))) {
+    return enif_make_badarg(env);
+  }
+
+  // Room for max delay plus the extra points needed by cubic interpolation
+  unsigned int max_samples = (unsigned int) ceil(max_delay * rate);
+  unsigned int size = next_pow2(max_samples + 4);
+
+  Delay * unit = enif_alloc_resource(delay_type, sizeof(Delay) + size * sizeof(float));
+  if (unit == NULL) {
+    return enif_raise_exception(env, enif_make_atom(env, "enomem"));
+  }
+  unit->rate = rate;
+  unit->max_delay = (max_samples < 2)? 2.f:max_samples;
+  unit->mask = size - 1;
+  unit->iwrite = 0;
+  memset(unit->buf, 0, size * sizeof(float));
+
+  if (strcmp(type, "comb") == 0) {
+    unit->type = COMB;
+  } else if (strcmp(type, "allpass") == 0) {
+    unit->type = ALLPASS;
+  } else {
+    unit->type = DELAY;
+  }
+
+  if (strcmp(interp, "none") == 0) {
+    unit->interp = NONE;
+  } else if (strcmp(interp, "cubic") == 0) {
+    unit->interp = CUBIC;
+  } else {
+    unit->interp = LINEAR;
+  }
+
+  ERL_NIF_TERM term = enif_make_resource(env, unit);
+  enif_release_resource(unit);
+  return term;
+}
+
+static ERL_NIF_TERM delay_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Delay * unit; // state pointer
+
+  // Audio rate input output
+  ErlNifBinary in_bin;
+  float * out, * in;
+  ERL_NIF_TERM out_term;
+
+  // Delay time in seconds, control rate (float) or audio rate (binary)
+  ErlNifBinary delay_bin;
+  float * delay_in = NULL;
+  double delay = 0.0;
+  double feedback;
+
+  if (!enif_get_resource(env, argv[0],
+                         delay_type,
+                         (void**) &unit)){
+    return enif_make_badarg(env);
+  }
+
+  if(!enif_inspect_binary(env, argv[1], &in_bin)){
+    return enif_make_badarg(env);
+  }
+
+  if(enif_inspect_binary(env, argv[2], &delay_bin)) {
+    if(delay_bin.size != in_bin.size) {
+      return enif_make_badarg(env);
+    }
+    delay_in = (float *) delay_bin.data;
+  } else if(!enif_get_double(env, argv[2], &delay)) {
+    return enif_make_badarg(env);
+  }
+
+  if(!enif_get_double(env, argv[3], &feedback)) {
+    return enif_make_badarg(env);
+  }
+
+  unsigned int no_of_frames = in_bin.size / sizeof(float);
+  in = (float *) in_bin.data;
+  out = (float *) enif_make_new_binary(env, in_bin.size, &out_term);
+
+  switch(unit->interp) {
+  case NONE:
+    delay_loop(unit, in, out, no_of_frames, delay_in, delay, feedback, NONE);
+    break;
+  case LINEAR:
+    delay_loop(unit, in, out, no_of_frames, delay_in, delay, feedback, LINEAR);
+    break;
+  case CUBIC:
+    delay_loop(unit, in, out, no_of_frames, delay_in, delay, feedback, CUBIC);
+    break;
+  }
+
+  return out_term;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ErlNifFunc nif_funcs[] = {
+  {"delay_ctor", 4, delay_ctor},
+  {"delay_next", 4, delay_next}
+};
+
+static int open_delay_resource_type(ErlNifEnv* env)
+{
+  const char* mod = "Elixir.Granulix.Filter.Delay";
+  const char* resource_type = "delay";
+  int flags = ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER;
+  delay_type =
+    enif_open_resource_type(env, mod, resource_type,
+                            NULL, flags, NULL);
+  return ((delay_type == NULL) ? -1:0);
+}
+
+static int load(ErlNifEnv* caller_env, void** priv_data, ERL_NIF_TERM load_info)
+{
+  return open_delay_resource_type(caller_env);
+}
+
+static int upgrade(ErlNifEnv* caller_env, void** priv_data, void** old_priv_data,
+		   ERL_NIF_TERM load_info)
+{
+  return open_delay_resource_type(caller_env);
+}
+
+
+ERL_NIF_INIT(Elixir.Granulix.Filter.Delay, nif_funcs, load, NULL, upgrade, NULL);
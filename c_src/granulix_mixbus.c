@@ -0,0 +1,264 @@
+#include <erl_nif.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/* Mix bus shared by many voice processes.
+
+   Voices add their frames straight into the bus instead of sending them
+   to a mixer process. Every scheduler has its own slot with a partial
+   sum, so voices running on different schedulers never touch the same
+   memory and there is no atomic operation per sample, only an
+   (uncontended) slot lock per call. Slots are cache line aligned so the
+   lock and counters of one slot never share a line with another. The
+   slot is picked from the scheduler id passed from Elixir; if the
+   process has migrated meanwhile the lock keeps it correct, just not
+   contention free.
+
+   Each slot is double buffered. Voices add into the open buffer, and
+   when the output process takes the period the buffers are flipped, the
+   closed ones from all slots are summed into the output and cleared.
+   Voices that asked for it are then sent {mixbus_ready, Period} to pace
+   their rendering, like the notify flag of Xalsa.send_frames.
+*/
+
+#define FRAME_TYPE float
+#define FRAME_SIZE sizeof(FRAME_TYPE)
+#define MAX_CHANNELS 16
+#define CACHE_LINE 64
+
+static ErlNifResourceType* mixbus_type;
+
+typedef struct
+{
+  ErlNifMutex * mutex;
+  float * buf[2];      // channels * period_size frames each
+  int used[2];
+  ErlNifPid * notify[2];
+  unsigned int no_of_notify[2];
+  unsigned int notify_capacity[2];
+} __attribute__((aligned(CACHE_LINE))) Slot;
+
+typedef struct
+{
+  unsigned int period_size;
+  unsigned int channels;
+  unsigned int no_of_slots;
+  int open;               // Buffer the voices add into
+  ErlNifUInt64 period;    // Number of periods taken
+  Slot * slots;           // Cache line aligned into slots_mem
+  void * slots_mem;
+} MixBus;
+
+/* ----------------------------------------------------------------------- */
+
+static inline void add_to(float * acc, const float * x, unsigned int n) {
+  unsigned int i = 0;
+#ifdef __AVX__
+  for(; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i),
+                                            _mm256_loadu_ps(x + i)));
+  }
+#endif
+  for(; i < n; i++) {
+    acc[i] += x[i];
+  }
+}
+
+static void mixbus_dtor(ErlNifEnv* env, void* obj)
+{
+  MixBus * bus = (MixBus *) obj;
+  if(bus->slots_mem == NULL) {
+    return;
+  }
+  for(unsigned int s = 0; s < bus->no_of_slots; s++) {
+    Slot * slot = &bus->slots[s];
+    for(int b = 0; b < 2; b++) {
+      enif_free(slot->buf[b]);
+      enif_free(slot->notify[b]);
+    }
+    enif_mutex_destroy(slot->mutex);
+  }
+  enif_free(bus->slots_mem);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ERL_NIF_TERM mixbus_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  unsigned int period_size, channels;
+  ErlNifSysInfo info;
+
+  if (!(enif_get_uint(env, argv[0], &period_size) && period_size > 0 &&
+        enif_get_uint(env, argv[1], &channels) &&
+        channels > 0 && channels <= MAX_CHANNELS)) {
+    return enif_make_badarg(env);
+  }
+
+  enif_system_info(&info, sizeof(ErlNifSysInfo));
+  unsigned int no_of_slots = (info.scheduler_threads > 0)? info.scheduler_threads:1;
+  size_t buf_size = period_size * channels * FRAME_SIZE;
+
+  MixBus * bus = enif_alloc_resource(mixbus_type, sizeof(MixBus));
+  bus->period_size = period_size;
+  bus->channels = channels;
+  bus->no_of_slots = no_of_slots;
+  bus->open = 0;
+  bus->period = 0;
+  bus->slots_mem = enif_alloc(no_of_slots * sizeof(Slot) + CACHE_LINE - 1);
+  bus->slots = (Slot *) (((uintptr_t) bus->slots_mem + CACHE_LINE - 1) &
+                         ~(uintptr_t) (CACHE_LINE - 1));
+  for(unsigned int s = 0; s < no_of_slots; s++) {
+    Slot * slot = &bus->slots[s];
+    slot->mutex = enif_mutex_create("granulix_mixbus_slot");
+    for(int b = 0; b < 2; b++) {
+      slot->buf[b] = (float *) enif_alloc(buf_size);
+      memset(slot->buf[b], 0, buf_size);
+      slot->used[b] = 0;
+      slot->notify[b] = NULL;
+      slot->no_of_notify[b] = 0;
+      slot->notify_capacity[b] = 0;
+    }
+  }
+  ERL_NIF_TERM term = enif_make_resource(env, bus);
+  enif_release_resource(bus);
+  return term;
+}
+
+/* mixbus_add(Bus, SchedulerId, Frames | [Frames], Notify) */
+static ERL_NIF_TERM mixbus_add(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  MixBus * bus;
+  unsigned int scheduler_id;
+  ErlNifBinary bins[MAX_CHANNELS];
+  unsigned int no_of_bins = 0;
+  char notify[6];
+
+  if (!(enif_get_resource(env, argv[0], mixbus_type, (void**) &bus) &&
+        enif_get_uint(env, argv[1], &scheduler_id) &&
+        enif_get_atom(env, argv[3], notify, 6, ERL_NIF_LATIN1))) {
+    return enif_make_badarg(env);
+  }
+
+  if (enif_inspect_binary(env, argv[2], &bins[0])) {
+    no_of_bins = 1;
+  } else {
+    ERL_NIF_TERM list = argv[2], head, tail;
+    while (enif_get_list_cell(env, list, &head, &tail)) {
+      if (no_of_bins == MAX_CHANNELS || !enif_inspect_binary(env, head, &bins[no_of_bins])) {
+        return enif_make_badarg(env);
+      }
+      no_of_bins++;
+      list = tail;
+    }
+  }
+  if (no_of_bins > bus->channels) {
+    no_of_bins = bus->channels;
+  }
+
+  unsigned int period_size = bus->period_size;
+  Slot * slot = &bus->slots[scheduler_id % bus->no_of_slots];
+
+  enif_mutex_lock(slot->mutex);
+  int b = __atomic_load_n(&bus->open, __ATOMIC_ACQUIRE);
+  for (unsigned int c = 0; c < no_of_bins; c++) {
+    unsigned int n = bins[c].size / FRAME_SIZE;
+    add_to(slot->buf[b] + c * period_size, (float *) bins[c].data,
+           (n < period_size)? n:period_size);
+  }
+  slot->used[b] = 1;
+  if (strcmp(notify, "true") == 0) {
+    if (slot->no_of_notify[b] == slot->notify_capacity[b]) {
+      slot->notify_capacity[b] = (slot->notify_capacity[b] == 0)? 8:(2 * slot->notify_capacity[b]);
+      slot->notify[b] = (ErlNifPid *) enif_realloc(slot->notify[b],
+                                                   slot->notify_capacity[b] * sizeof(ErlNifPid));
+    }
+    enif_self(env, &slot->notify[b][slot->no_of_notify[b]++]);
+  }
+  enif_mutex_unlock(slot->mutex);
+
+  return enif_make_atom(env, "ok");
+}
+
+/* Close the open period and return its sum, one binary per channel.
+   Only one process shall take from a bus. */
+static ERL_NIF_TERM mixbus_take(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  MixBus * bus;
+  ERL_NIF_TERM outs[MAX_CHANNELS];
+  float * out[MAX_CHANNELS];
+
+  if (!enif_get_resource(env, argv[0], mixbus_type, (void**) &bus)) {
+    return enif_make_badarg(env);
+  }
+
+  unsigned int period_size = bus->period_size;
+  unsigned int channels = bus->channels;
+  for (unsigned int c = 0; c < channels; c++) {
+    out[c] = (float *) enif_make_new_binary(env, period_size * FRAME_SIZE, &outs[c]);
+    memset(out[c], 0, period_size * FRAME_SIZE);
+  }
+
+  int b = bus->open;
+  __atomic_store_n(&bus->open, b ^ 1, __ATOMIC_RELEASE);
+  bus->period++;
+  ERL_NIF_TERM msg = enif_make_tuple2(env, enif_make_atom(env, "mixbus_ready"),
+                                      enif_make_uint64(env, bus->period));
+
+  for (unsigned int s = 0; s < bus->no_of_slots; s++) {
+    Slot * slot = &bus->slots[s];
+    enif_mutex_lock(slot->mutex);
+    if (slot->used[b]) {
+      for (unsigned int c = 0; c < channels; c++) {
+        add_to(out[c], slot->buf[b] + c * period_size, period_size);
+      }
+      memset(slot->buf[b], 0, bus->channels * period_size * FRAME_SIZE);
+      slot->used[b] = 0;
+    }
+    for (unsigned int i = 0; i < slot->no_of_notify[b]; i++) {
+      enif_send(env, &slot->notify[b][i], NULL, msg);
+    }
+    slot->no_of_notify[b] = 0;
+    enif_mutex_unlock(slot->mutex);
+  }
+
+  if (channels == 1) {
+    return outs[0];
+  }
+  return enif_make_list_from_array(env, outs, channels);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ErlNifFunc nif_funcs[] = {
+  {"mixbus_ctor", 2, mixbus_ctor},
+  {"mixbus_add", 4, mixbus_add},
+  {"mixbus_take", 1, mixbus_take}
+};
+
+static int open_mixbus_resource_type(ErlNifEnv* env)
+{
+  const char* mod = "Elixir.Granulix.MixBus";
+  const char* resource_type = "mixbus";
+  int flags = ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER;
+  mixbus_type =
+    enif_open_resource_type(env, mod, resource_type,
+                            mixbus_dtor, flags, NULL);
+  return ((mixbus_type == NULL) ? -1:0);
+}
+
+static int load(ErlNifEnv* caller_env, void** priv_data, ERL_NIF_TERM load_info)
+{
+  return open_mixbus_resource_type(caller_env);
+}
+
+static int upgrade(ErlNifEnv* caller_env, void** priv_data, void** old_priv_data,
+		   ERL_NIF_TERM load_info)
+{
+  return open_mixbus_resource_type(caller_env);
+}
+
+
+ERL_NIF_INIT(Elixir.Granulix.MixBus, nif_funcs, load, NULL, upgrade, NULL);
@@ -1,6 +1,7 @@
 #include <erl_nif.h>
 #include <math.h>
 #include <string.h>
+#include "granulix_oversample.h"
 
 /* Code translated from Elixir - Synthex.Filter.Moog:
 https://github.com/bitgamma/synthex/blob/master/lib/synthex/filter/moog.ex
@@ -16,12 +17,22 @@ typedef struct
      double cutoff, resonance;
   */
   float i1, i2, i3, i4, o1, o2, o3, o4;
+  Oversample os;
 } Moog;
 
 
 static ERL_NIF_TERM moog_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
+  unsigned int factor;
+  if (!enif_get_uint(env, argv[0], &factor)){
+    return enif_make_badarg(env);
+  }
+
   Moog * unit  = enif_alloc_resource(moog_type, sizeof(Moog));
+  if (!oversample_init(&unit->os, factor)) {
+    enif_release_resource(unit);
+    return enif_make_badarg(env);
+  }
   unit->i1 = unit->i2 = unit->i3 = unit->i4 = 0.0;
   unit->o1 = unit->o2 = unit->o3 = unit->o4 = 0.0;
   ERL_NIF_TERM term = enif_make_resource(env, unit);
@@ -64,6 +75,17 @@ static ERL_NIF_TERM moog_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[
   in = (float * ) in_bin.data;
   out = (float *) enif_make_new_binary(env, in_bin.size, &out_term);
 
+  // When oversampling, run the ladder in place on the work buffer
+  float * work = NULL;
+  float * src = in, * dst = out;
+  if (unit->os.stages > 0) {
+    work = (float *) enif_alloc(oversample_work_size(&unit->os, no_of_frames) * sizeof(float));
+    oversample_up(&unit->os, in, no_of_frames, work);
+    src = dst = work;
+    no_of_frames *= unit->os.factor;
+    cutoff /= unit->os.factor;
+  }
+
   i1 = unit->i1; i2 = unit->i2; i3 = unit->i3; i4 = unit->i4;
   o1 = unit->o1; o2 = unit->o2; o3 = unit->o3; o4 = unit->o4;
 
@@ -75,7 +97,7 @@ static ERL_NIF_TERM moog_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[
   sample = output =  0.0;
 
   for (int i = 0; i < no_of_frames; i++) {
-    sample = in[i];
+    sample = src[i];
     sample = sample - o4 * fb;
     sample = sample * f2;
     o1 = sample + 0.3 * i1 + (1 - f) * o1;
@@ -86,7 +108,12 @@ static ERL_NIF_TERM moog_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[
     i2 = o1;
     i3 = o2;
     i4 = o3;
-    out[i] = o4;
+    dst[i] = o4;
+  }
+
+  if (work) {
+    oversample_down(&unit->os, work, no_of_frames / unit->os.factor, out);
+    enif_free(work);
   }
 
   // Variables were updated need to be stored back into the state
@@ -99,7 +126,7 @@ static ERL_NIF_TERM moog_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[
 /* ----------------------------------------------------------------------- */
 
 static ErlNifFunc nif_funcs[] = {
-  {"moog_ctor", 0, moog_ctor},
+  {"moog_ctor", 1, moog_ctor},
   {"moog_next", 4, moog_next}
 };
 
@@ -116,12 +143,14 @@ static int open_moog_resource_type(ErlNifEnv* env)
 
 static int load(ErlNifEnv* caller_env, void** priv_data, ERL_NIF_TERM load_info)
 {
+  oversample_init_coefs();
   return open_moog_resource_type(caller_env);
 }
 
 static int upgrade(ErlNifEnv* caller_env, void** priv_data, void** old_priv_data,
 		   ERL_NIF_TERM load_info)
 {
+  oversample_init_coefs();
   return open_moog_resource_type(caller_env);
 }
 
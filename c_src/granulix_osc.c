@@ -6,47 +6,87 @@
 static ErlNifResourceType* osc_type;
 static float twopi = 2 * acosf(-1.0);
 
-static float saw(float progress) {
-  return (1.0 - progress);
+/* Every waveform has its own loop in osc_next, no function pointer is
+   called per frame. The phase goes from 0 to 1 for all of them.
+
+   The band limited variants correct the naive waveform around each
+   discontinuity with a PolyBLEP (saw, square/pulse) and around each
+   corner with a PolyBLAMP (triangle), see e.g. Valimaki et al.
+   "Antialiasing Oscillators in Subtractive Synthesis" and "Rounding
+   Corners with BLAMP". */
+
+// Residual of a step of -2 at phase 0
+static inline float polyblep(float t, float dt) {
+  if (t < dt) {
+    t /= dt;
+    return t + t - t * t - 1.f;
+  } else if (t > 1.f - dt) {
+    t = (t - 1.f) / dt;
+    return t * t + t + t + 1.f;
+  }
+  return 0.f;
 }
 
-static float triangle(float progress) {
-  // 0.0 <= progress < 4.0
-  return (progress < 2.f)?(progress - 1.f):(3.f - progress);
+// Integrated polyblep, residual of a corner at phase 0
+static inline float polyblamp(float t, float dt) {
+  if (t < dt) {
+    t = t / dt - 1.f;
+    return -1.f / 3.f * t * t * t;
+  } else if (t > 1.f - dt) {
+    t = (t - 1.f) / dt + 1.f;
+    return 1.f / 3.f * t * t * t;
+  }
+  return 0.f;
+}
+
+static inline float wrap(float t) {
+  return (t < 1.f)? t:(t - 1.f);
 }
 
 /* ----------------------------------------------------------------------- */
+typedef enum
+  {
+    SIN,
+    SAW,
+    TRIANGLE,
+    SQUARE
+  } OscType;
+
 typedef struct
 {
   unsigned int rate;
+  OscType type;
+  int bandlimited;
   float phase;
-  float max;
-  float (*f)(float);
 } Osc;
 
 static ERL_NIF_TERM osc_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
   unsigned int rate;
   char type[12];
+  char bandlimited[6];
   if (!enif_get_uint(env, argv[0], &rate)){
     return enif_make_badarg(env);
   }
   if (!enif_get_atom(env, argv[1], type, 12, ERL_NIF_LATIN1)){
     return enif_make_badarg(env);
   }
+  if (!enif_get_atom(env, argv[2], bandlimited, 6, ERL_NIF_LATIN1)){
+    return enif_make_badarg(env);
+  }
 
   Osc *unit  = enif_alloc_resource(osc_type, sizeof(Osc));
   unit->rate = rate;
   if (strcmp(type, "sin") == 0) {
-    unit->f = &sinf;
-    unit->max = twopi;
+    unit->type = SIN;
   } else if (strcmp(type, "saw") == 0) {
-    unit->f = &saw;
-    unit->max = 2.0;
+    unit->type = SAW;
+  } else if (strcmp(type, "square") == 0) {
+    unit->type = SQUARE;
   } else {
-    unit->f = &triangle;
-    unit->max = 4.0;
+    unit->type = TRIANGLE;
   }
+  unit->bandlimited = (strcmp(bandlimited, "true") == 0);
   unit->phase = 0.0;
   ERL_NIF_TERM term = enif_make_resource(env, unit);
   enif_release_resource(unit);
@@ -58,6 +98,7 @@ static ERL_NIF_TERM osc_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]
   unsigned int no_of_frames;
   float phase;
   double freq;
+  double width; // Pulse width for square, 0 < width < 1
   ERL_NIF_TERM new_binary;
 
   if (!enif_get_resource(env, argv[0], osc_type, (void**) &unit)){
@@ -70,13 +111,68 @@ static ERL_NIF_TERM osc_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]
   if (!enif_get_uint(env, argv[2], &no_of_frames)){
     return enif_make_badarg(env);
   }
+  if (!(enif_get_double(env, argv[3], &width) && width > 0.0 && width < 1.0)){
+    return enif_make_badarg(env);
+  }
 
   unsigned int bin_size = no_of_frames * FRAME_SIZE;
   FRAME_TYPE * data = (FRAME_TYPE *) enif_make_new_binary(env, bin_size, &new_binary);
-  float delta = unit->max * freq / unit->rate;
-  for(unsigned int i = 0; i < no_of_frames; i++){
-    data[i] = (*unit->f)(phase);
-    phase = advance_phase(phase + delta, unit->max);
+  float dt = freq / unit->rate;
+  float w = width;
+  unsigned int i;
+
+  switch(unit->type) {
+  case SIN:
+    for(i = 0; i < no_of_frames; i++){
+      data[i] = sinf(twopi * phase);
+      phase = advance_phase(phase + dt, 1.0);
+    }
+    break;
+  case SAW:
+    if (unit->bandlimited) {
+      for(i = 0; i < no_of_frames; i++){
+        data[i] = 1.f - 2.f * phase + polyblep(phase, dt);
+        phase = advance_phase(phase + dt, 1.0);
+      }
+    } else {
+      for(i = 0; i < no_of_frames; i++){
+        data[i] = 1.f - 2.f * phase;
+        phase = advance_phase(phase + dt, 1.0);
+      }
+    }
+    break;
+  case TRIANGLE:
+    if (unit->bandlimited) {
+      float corner = 4.f * dt;
+      for(i = 0; i < no_of_frames; i++){
+        float y = (phase < 0.5f)? (4.f * phase - 1.f):(3.f - 4.f * phase);
+        y += corner * (polyblamp(phase, dt) - polyblamp(wrap(phase + 0.5f), dt));
+        data[i] = y;
+        phase = advance_phase(phase + dt, 1.0);
+      }
+    } else {
+      for(i = 0; i < no_of_frames; i++){
+        data[i] = (phase < 0.5f)? (4.f * phase - 1.f):(3.f - 4.f * phase);
+        phase = advance_phase(phase + dt, 1.0);
+      }
+    }
+    break;
+  case SQUARE:
+    if (unit->bandlimited) {
+      float fall = 1.f - w;
+      for(i = 0; i < no_of_frames; i++){
+        float y = (phase < w)? 1.f:-1.f;
+        y += polyblep(phase, dt) - polyblep(wrap(phase + fall), dt);
+        data[i] = y;
+        phase = advance_phase(phase + dt, 1.0);
+      }
+    } else {
+      for(i = 0; i < no_of_frames; i++){
+        data[i] = (phase < w)? 1.f:-1.f;
+        phase = advance_phase(phase + dt, 1.0);
+      }
+    }
+    break;
   }
   unit->phase = phase;
   return new_binary;
@@ -85,8 +181,8 @@ static ERL_NIF_TERM osc_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]
 /* ----------------------------------------------------------------------- */
 
 static ErlNifFunc nif_funcs[] = {
-  {"osc_ctor", 2, osc_ctor},
-  {"osc_next", 3, osc_next}
+  {"osc_ctor", 3, osc_ctor},
+  {"osc_next", 4, osc_next}
 };
 
 static int open_osc_resource_type(ErlNifEnv* env)
@@ -0,0 +1,252 @@
+#include <erl_nif.h>
+#include <math.h>
+#include <string.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/* Additive synthesis, a bank of sine partials summed in one call.
+
+   Instead of calling sinf per sample and partial, each partial is a
+   complex phasor (re, im) rotated by (cos w, sin w) every sample, and im
+   is the sine output. The partials are kept as separate arrays (SoA) so
+   8 of them are rotated at a time with AVX. The rotation slowly drifts
+   from the unit circle, so the phasors are renormalized every
+   RENORM_INTERVAL frames.
+
+   New frequencies take effect from the start of the next call, new
+   amplitudes are ramped linearly over it. Partials at or above the
+   Nyquist frequency are muted.
+*/
+
+#define FRAME_TYPE float
+#define FRAME_SIZE sizeof(FRAME_TYPE)
+#define LANES 8
+#define RENORM_INTERVAL 256
+
+static ErlNifResourceType* oscbank_type;
+
+typedef struct
+{
+  unsigned int rate;
+  unsigned int no_of_partials; // As given
+  unsigned int size;           // Padded to a multiple of LANES
+  float * freq;   // Frequency in Hz
+  float * amp;    // Current amplitude
+  float * target; // Amplitude to ramp to during the next call
+  float * re, * im;
+  float * c, * s; // Rotation per frame
+  float data[];
+} OscBank;
+
+/* ----------------------------------------------------------------------- */
+
+static inline void set_rotation(OscBank * unit, unsigned int k, float freq) {
+  double w = 2.0 * M_PI * freq / unit->rate;
+  unit->freq[k] = freq;
+  unit->c[k] = cos(w);
+  unit->s[k] = sin(w);
+}
+
+static inline float audible(OscBank * unit, unsigned int k, float amp) {
+  return (unit->freq[k] < 0.5f * unit->rate)? amp:0.f;
+}
+
+static void renormalize(OscBank * unit, unsigned int from, unsigned int to) {
+  for(unsigned int k = from; k < to; k++) {
+    float r = unit->re[k] * unit->re[k] + unit->im[k] * unit->im[k];
+    // First order approximation of 1 / sqrt(r), r is always close to 1
+    float g = 1.5f - 0.5f * r;
+    unit->re[k] *= g;
+    unit->im[k] *= g;
+  }
+}
+
+/* Render n frames of partials [from, from + LANES) added into acc, which
+   holds LANES partial sums per frame. */
+static inline void render_lanes(OscBank * unit, unsigned int from,
+                                float * acc, unsigned int n, float inv_n) {
+#ifdef __AVX__
+  __m256 re = _mm256_loadu_ps(unit->re + from);
+  __m256 im = _mm256_loadu_ps(unit->im + from);
+  __m256 c = _mm256_loadu_ps(unit->c + from);
+  __m256 s = _mm256_loadu_ps(unit->s + from);
+  __m256 amp = _mm256_loadu_ps(unit->amp + from);
+  __m256 damp = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(unit->target + from), amp),
+                              _mm256_set1_ps(inv_n));
+  for(unsigned int i = 0; i < n; i++) {
+    __m256 a = _mm256_loadu_ps(acc + i * LANES);
+    _mm256_storeu_ps(acc + i * LANES, _mm256_add_ps(a, _mm256_mul_ps(amp, im)));
+    __m256 re1 = _mm256_sub_ps(_mm256_mul_ps(re, c), _mm256_mul_ps(im, s));
+    im = _mm256_add_ps(_mm256_mul_ps(re, s), _mm256_mul_ps(im, c));
+    re = re1;
+    amp = _mm256_add_ps(amp, damp);
+  }
+  _mm256_storeu_ps(unit->re + from, re);
+  _mm256_storeu_ps(unit->im + from, im);
+  _mm256_storeu_ps(unit->amp + from, amp);
+#else
+  for(unsigned int l = 0; l < LANES; l++) {
+    unsigned int k = from + l;
+    float re = unit->re[k], im = unit->im[k];
+    float c = unit->c[k], s = unit->s[k];
+    float amp = unit->amp[k];
+    float damp = (unit->target[k] - amp) * inv_n;
+    for(unsigned int i = 0; i < n; i++) {
+      acc[i * LANES + l] += amp * im;
+      float re1 = re * c - im * s;
+      im = re * s + im * c;
+      re = re1;
+      amp += damp;
+    }
+    unit->re[k] = re; unit->im[k] = im; unit->amp[k] = amp;
+  }
+#endif
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ERL_NIF_TERM oscbank_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  unsigned int rate, no_of_partials;
+
+  if (!(enif_get_uint(env, argv[0], &rate) &&
+        enif_get_uint(env, argv[1], &no_of_partials) && no_of_partials > 0)) {
+    return enif_make_badarg(env);
+  }
+
+  unsigned int size = (no_of_partials + LANES - 1) / LANES * LANES;
+  OscBank * unit = enif_alloc_resource(oscbank_type,
+                                       sizeof(OscBank) + 7 * size * sizeof(float));
+  unit->rate = rate;
+  unit->no_of_partials = no_of_partials;
+  unit->size = size;
+  unit->freq = unit->data;
+  unit->amp = unit->freq + size;
+  unit->target = unit->amp + size;
+  unit->re = unit->target + size;
+  unit->im = unit->re + size;
+  unit->c = unit->im + size;
+  unit->s = unit->c + size;
+  for(unsigned int k = 0; k < size; k++) {
+    unit->amp[k] = unit->target[k] = 0.f;
+    unit->re[k] = 1.f;
+    unit->im[k] = 0.f;
+    set_rotation(unit, k, 0.f);
+  }
+
+  ERL_NIF_TERM term = enif_make_resource(env, unit);
+  enif_release_resource(unit);
+  return term;
+}
+
+/* oscbank_next(Ref, NoOfFrames, Frequencies, Amplitudes)
+   Frequencies and amplitudes are binaries of 32 bit floats, one per
+   partial, or nil to keep the current ones. */
+static ERL_NIF_TERM oscbank_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  OscBank * unit;
+  unsigned int no_of_frames;
+  ErlNifBinary freq_bin, amp_bin;
+  int new_freq, new_amp;
+  ERL_NIF_TERM out_term;
+
+  if (!(enif_get_resource(env, argv[0], oscbank_type, (void**) &unit) &&
+        enif_get_uint(env, argv[1], &no_of_frames))) {
+    return enif_make_badarg(env);
+  }
+
+  unsigned int partials_size = unit->no_of_partials * FRAME_SIZE;
+  new_freq = enif_inspect_binary(env, argv[2], &freq_bin);
+  new_amp = enif_inspect_binary(env, argv[3], &amp_bin);
+  if ((new_freq && freq_bin.size != partials_size) ||
+      (new_amp && amp_bin.size != partials_size) ||
+      (!new_freq && !enif_is_atom(env, argv[2])) ||
+      (!new_amp && !enif_is_atom(env, argv[3]))) {
+    return enif_make_badarg(env);
+  }
+
+  if (new_freq) {
+    float * freq = (float *) freq_bin.data;
+    for(unsigned int k = 0; k < unit->no_of_partials; k++) {
+      if (freq[k] != unit->freq[k]) {
+        set_rotation(unit, k, freq[k]);
+        // Keep the amplitude of partials moving above Nyquist at 0
+        unit->target[k] = audible(unit, k, unit->target[k]);
+      }
+    }
+  }
+  if (new_amp) {
+    float * amp = (float *) amp_bin.data;
+    for(unsigned int k = 0; k < unit->no_of_partials; k++) {
+      unit->target[k] = audible(unit, k, amp[k]);
+    }
+  }
+
+  float * out = (float *) enif_make_new_binary(env, no_of_frames * FRAME_SIZE, &out_term);
+  unsigned int chunk = (no_of_frames < RENORM_INTERVAL)? no_of_frames:RENORM_INTERVAL;
+  float * acc = (float *) enif_alloc(chunk * LANES * FRAME_SIZE);
+  // Amplitudes ramp over the whole call, so keep the targets per chunk
+  float * target = (float *) enif_alloc(unit->size * FRAME_SIZE);
+  memcpy(target, unit->target, unit->size * FRAME_SIZE);
+
+  for(unsigned int start = 0; start < no_of_frames; start += chunk) {
+    unsigned int n = (no_of_frames - start < chunk)? (no_of_frames - start):chunk;
+    // Ramp to the point of the target reached at the end of this chunk
+    float frac = (float) n / (no_of_frames - start);
+    for(unsigned int k = 0; k < unit->size; k++) {
+      unit->target[k] = unit->amp[k] + (target[k] - unit->amp[k]) * frac;
+    }
+    memset(acc, 0, n * LANES * FRAME_SIZE);
+    for(unsigned int k = 0; k < unit->size; k += LANES) {
+      render_lanes(unit, k, acc, n, 1.f / n);
+    }
+    renormalize(unit, 0, unit->size);
+    for(unsigned int i = 0; i < n; i++) {
+      float sum = 0.f;
+      for(unsigned int l = 0; l < LANES; l++) {
+        sum += acc[i * LANES + l];
+      }
+      out[start + i] = sum;
+    }
+  }
+
+  // Land exactly on the target amplitudes
+  memcpy(unit->target, target, unit->size * FRAME_SIZE);
+  memcpy(unit->amp, target, unit->size * FRAME_SIZE);
+  enif_free(target);
+  enif_free(acc);
+  return out_term;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ErlNifFunc nif_funcs[] = {
+  {"oscbank_ctor", 2, oscbank_ctor},
+  {"oscbank_next", 4, oscbank_next}
+};
+
+static int open_oscbank_resource_type(ErlNifEnv* env)
+{
+  const char* mod = "Elixir.Granulix.Generator.OscBank";
+  const char* resource_type = "oscbank";
+  int flags = ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER;
+  oscbank_type =
+    enif_open_resource_type(env, mod, resource_type,
+                            NULL, flags, NULL);
+  return ((oscbank_type == NULL) ? -1:0);
+}
+
+static int load(ErlNifEnv* caller_env, void** priv_data, ERL_NIF_TERM load_info)
+{
+  return open_oscbank_resource_type(caller_env);
+}
+
+static int upgrade(ErlNifEnv* caller_env, void** priv_data, void** old_priv_data,
+		   ERL_NIF_TERM load_info)
+{
+  return open_oscbank_resource_type(caller_env);
+}
+
+
+ERL_NIF_INIT(Elixir.Granulix.Generator.OscBank, nif_funcs, load, NULL, upgrade, NULL);
@@ -0,0 +1,159 @@
+/* Oversampling for nonlinear units, 2x, 4x or 8x, as a cascade of
+   half-band polyphase filter stages.
+
+   A half-band filter has every other coefficient equal to zero except
+   the center one which is 0.5. Upsampling by two then means the even
+   output frames are the (delayed) input and only the odd ones need an
+   inner product, and downsampling by two is an inner product over the
+   odd input frames plus half of the delayed even one. The inner products
+   are HB_TAPS long and use AVX when available.
+
+   The including file calls oversample_init_coefs() when loaded, keeps
+   an Oversample struct in its resource and wraps its processing loop
+   with oversample_up() and oversample_down(), see granulix_moog.c.
+*/
+#include <math.h>
+#include <string.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#define HB_TAPS 24 // Taps in the odd branch, multiple of 8
+#define HB_HALF (HB_TAPS / 2)
+#define MAX_OVERSAMPLE_STAGES 3 // 8x
+
+typedef struct
+{
+  float up[HB_TAPS];        // Input history
+  float down_odd[HB_TAPS];  // Odd input frame history
+  float down_even[HB_HALF]; // Even input frame delay line
+} HalfBand;
+
+typedef struct
+{
+  unsigned int factor; // 1, 2, 4 or 8
+  unsigned int stages;
+  HalfBand hb[MAX_OVERSAMPLE_STAGES];
+} Oversample;
+
+// Odd branch coefficients, with unity DC gain for the branch
+static float hb_coefs[HB_TAPS];
+
+static inline void oversample_init_coefs(void) {
+  // Kaiser windowed sinc over the 2 * HB_TAPS - 1 long half-band filter
+  const double beta = 7.0;
+  double i0beta = 1.0, term = 1.0, sum = 0.0;
+  for(int k = 1; k < 32; k++) {
+    term *= beta * 0.5 / k;
+    i0beta += term * term;
+  }
+  for(int i = 0; i < HB_TAPS; i++) {
+    int k = HB_TAPS - 1 - 2 * i; // Odd tap offset from the center
+    double x = (double) k / HB_TAPS;
+    double arg = beta * sqrt(1.0 - x * x) * 0.5, i0 = 1.0;
+    term = 1.0;
+    for(int j = 1; j < 32; j++) {
+      term *= arg / j;
+      i0 += term * term;
+    }
+    double s = sin(M_PI * k * 0.5) / (M_PI * k * 0.5);
+    hb_coefs[i] = s * i0 / i0beta;
+    sum += hb_coefs[i];
+  }
+  for(int i = 0; i < HB_TAPS; i++) {
+    hb_coefs[i] /= sum;
+  }
+}
+
+static inline int oversample_init(Oversample * os, unsigned int factor) {
+  switch(factor) {
+  case 1: os->stages = 0; break;
+  case 2: os->stages = 1; break;
+  case 4: os->stages = 2; break;
+  case 8: os->stages = 3; break;
+  default: return 0;
+  }
+  os->factor = factor;
+  memset(os->hb, 0, sizeof(os->hb));
+  return 1;
+}
+
+/* Size in frames of the work buffer needed for n frames at the base rate.
+   The first n * factor frames hold the oversampled signal. */
+static inline unsigned int oversample_work_size(Oversample * os, unsigned int n) {
+  return 2 * (n * os->factor + HB_TAPS);
+}
+
+static inline float hb_dot(const float * x) {
+#ifdef __AVX__
+  __m256 acc = _mm256_setzero_ps();
+  for(unsigned int k = 0; k < HB_TAPS; k += 8) {
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(x + k),
+                                           _mm256_loadu_ps(hb_coefs + k)));
+  }
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc),
+                        _mm256_extractf128_ps(acc, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+  return _mm_cvtss_f32(s);
+#else
+  float acc = 0.f;
+  for(unsigned int k = 0; k < HB_TAPS; k++) {
+    acc += x[k] * hb_coefs[k];
+  }
+  return acc;
+#endif
+}
+
+// len frames in buf become 2 * len frames, tmp holds HB_TAPS + len
+static inline void hb_up(HalfBand * hb, float * buf, unsigned int len, float * tmp) {
+  memcpy(tmp, hb->up, HB_TAPS * sizeof(float));
+  memcpy(tmp + HB_TAPS, buf, len * sizeof(float));
+  for(unsigned int i = 0; i < len; i++) {
+    const float * x = tmp + i + 1;
+    buf[2 * i] = x[HB_HALF - 1];
+    buf[2 * i + 1] = hb_dot(x);
+  }
+  memcpy(hb->up, tmp + len, HB_TAPS * sizeof(float));
+}
+
+// 2 * len frames in buf become len frames, tmp holds HB_TAPS + 2 * len
+static inline void hb_down(HalfBand * hb, float * buf, unsigned int len, float * tmp) {
+  float * odd = tmp;
+  float * even = tmp + HB_TAPS + len;
+  memcpy(odd, hb->down_odd, HB_TAPS * sizeof(float));
+  memcpy(even, hb->down_even, HB_HALF * sizeof(float));
+  for(unsigned int i = 0; i < len; i++) {
+    even[HB_HALF + i] = buf[2 * i];
+    odd[HB_TAPS + i] = buf[2 * i + 1];
+  }
+  for(unsigned int i = 0; i < len; i++) {
+    buf[i] = 0.5f * (even[i + 1] + hb_dot(odd + i + 1));
+  }
+  memcpy(hb->down_odd, odd + len, HB_TAPS * sizeof(float));
+  memcpy(hb->down_even, even + len, HB_HALF * sizeof(float));
+}
+
+// n frames from in are oversampled into the start of work
+static inline void oversample_up(Oversample * os, const float * in, unsigned int n,
+                                 float * work) {
+  unsigned int len = n;
+  float * tmp = work + n * os->factor;
+  memcpy(work, in, n * sizeof(float));
+  for(unsigned int s = 0; s < os->stages; s++) {
+    hb_up(&os->hb[s], work, len, tmp);
+    len *= 2;
+  }
+}
+
+// n * factor frames at the start of work are decimated into n frames in out
+static inline void oversample_down(Oversample * os, float * work, unsigned int n,
+                                   float * out) {
+  unsigned int len = n * os->factor;
+  float * tmp = work + len;
+  for(unsigned int s = os->stages; s > 0; s--) {
+    len /= 2;
+    hb_down(&os->hb[s - 1], work, len, tmp);
+  }
+  memcpy(out, work, n * sizeof(float));
+}
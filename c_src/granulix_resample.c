@@ -0,0 +1,300 @@
+#include <erl_nif.h>
+#include <math.h>
+#include <string.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/* Polyphase windowed-sinc sample rate converter.
+
+   The filter is a Kaiser windowed sinc with cutoff at the lower of the
+   two Nyquist frequencies, stored as a table of phases, each with
+   no_of_taps coefficients. When the rate ratio reduces to out/in = L/M
+   with L <= MAX_PHASES (e.g. 44100 <-> 48000 is 160/147) the table holds
+   exactly L phases and stepping is done in integers, so there is no
+   drift or phase interpolation. Otherwise, or when a variable ratio is
+   asked for, the table has MAX_PHASES phases and the output is linearly
+   interpolated between the two nearest ones.
+
+   The output frame count is computed before rendering so the frames are
+   written straight into the result binary. Only the first windows of a
+   call reach back into the previous input; they are read from hist,
+   which holds the history followed by the first frames of the call.
+*/
+
+#define FRAME_TYPE float
+#define FRAME_SIZE sizeof(FRAME_TYPE)
+#define MAX_PHASES 256
+// Limit for out/in rate and for the variable ratio, and its inverse,
+// so one call never renders more than MAX_RATIO^2 times its input
+#define MAX_RATIO 64.0
+
+static ErlNifResourceType* resample_type;
+
+typedef struct
+{
+  unsigned int no_of_taps;   // Multiple of 8
+  unsigned int no_of_phases;
+  int exact;                 // Integer phase stepping, L/M ratio
+  unsigned int up, down;     // L and M when exact
+  unsigned int iphase;       // Current phase when exact
+  double step;               // Input samples per output sample
+  double pos;                // Read position in input samples
+  float * hist;              // no_of_taps last input frames, then as
+                             // many new ones for windows straddling them
+  float * table;             // (no_of_phases + 1) * no_of_taps coefficients
+  float data[];
+} Resample;
+
+/* ----------------------------------------------------------------------- */
+
+static unsigned int gcd(unsigned int a, unsigned int b) {
+  while(b != 0) {
+    unsigned int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Zeroth order modified Bessel function of the first kind
+static double bessel_i0(double x) {
+  double sum = 1.0, term = 1.0, halfx = x * 0.5;
+  for(int k = 1; k < 32; k++) {
+    term *= halfx / k;
+    sum += term * term;
+  }
+  return sum;
+}
+
+static void make_table(Resample * unit, double cutoff, double beta) {
+  unsigned int taps = unit->no_of_taps;
+  unsigned int phases = unit->no_of_phases;
+  double half = taps / 2;
+  double i0beta = bessel_i0(beta);
+
+  for(unsigned int p = 0; p <= phases; p++) {
+    float * h = unit->table + p * taps;
+    double frac = (double) p / phases;
+    double sum = 0.0;
+    for(unsigned int k = 0; k < taps; k++) {
+      // Distance from the output position to input tap k
+      double d = k - half + 1.0 - frac;
+      double x = d / half;
+      double w = (x * x < 1.0)? bessel_i0(beta * sqrt(1.0 - x * x)) / i0beta:0.0;
+      double arg = M_PI * cutoff * d;
+      double s = (d == 0.0)? cutoff:(sin(arg) / (M_PI * d));
+      h[k] = s * w;
+      sum += h[k];
+    }
+    // Unity gain at DC for every phase
+    for(unsigned int k = 0; k < taps; k++) {
+      h[k] /= sum;
+    }
+  }
+}
+
+static inline float dot(const float * x, const float * h, unsigned int n) {
+#ifdef __AVX__
+  __m256 acc = _mm256_setzero_ps();
+  for(unsigned int k = 0; k < n; k += 8) {
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(x + k),
+                                           _mm256_loadu_ps(h + k)));
+  }
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc),
+                        _mm256_extractf128_ps(acc, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+  return _mm_cvtss_f32(s);
+#else
+  float acc = 0.f;
+  for(unsigned int k = 0; k < n; k++) {
+    acc += x[k] * h[k];
+  }
+  return acc;
+#endif
+}
+
+/* Window of taps frames starting at input position start, where
+   positions below taps are in the history */
+static inline const float * window(const float * hist, const float * in,
+                                   unsigned int taps, unsigned int start) {
+  return (start < taps)? (hist + start):(in + start - taps);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ERL_NIF_TERM resample_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  unsigned int in_rate, out_rate;
+  char quality[12];
+  char variable[6];
+  unsigned int taps;
+  double rolloff, beta;
+
+  if (!(enif_get_uint(env, argv[0], &in_rate) && in_rate > 0 &&
+        enif_get_uint(env, argv[1], &out_rate) && out_rate > 0 &&
+        out_rate <= MAX_RATIO * in_rate && in_rate <= MAX_RATIO * out_rate &&
+        enif_get_atom(env, argv[2], quality, 12, ERL_NIF_LATIN1) &&
+        enif_get_atom(env, argv[3], variable, 6, ERL_NIF_LATIN1))) {
+    return enif_make_badarg(env);
+  }
+
+  if (strcmp(quality, "low") == 0) {
+    taps = 16; rolloff = 0.90; beta = 6.0;
+  } else if (strcmp(quality, "high") == 0) {
+    taps = 64; rolloff = 0.97; beta = 10.0;
+  } else {
+    taps = 32; rolloff = 0.94; beta = 8.0;
+  }
+
+  unsigned int g = gcd(in_rate, out_rate);
+  unsigned int up = out_rate / g;
+  unsigned int down = in_rate / g;
+  int exact = (strcmp(variable, "false") == 0) && (up <= MAX_PHASES);
+  unsigned int phases = exact? up:MAX_PHASES;
+
+  size_t size = sizeof(Resample) + (2 * taps + (phases + 1) * taps) * sizeof(float);
+  Resample * unit = enif_alloc_resource(resample_type, size);
+  unit->no_of_taps = taps;
+  unit->no_of_phases = phases;
+  unit->exact = exact;
+  unit->up = up;
+  unit->down = down;
+  unit->iphase = 0;
+  unit->step = (double) in_rate / out_rate;
+  // Start with the first window fully inside history (zeros)
+  unit->pos = taps / 2 - 1;
+  unit->hist = unit->data;
+  unit->table = unit->data + 2 * taps;
+  memset(unit->hist, 0, 2 * taps * sizeof(float));
+
+  double cutoff = rolloff * ((out_rate < in_rate)? (double) out_rate / in_rate:1.0);
+  make_table(unit, cutoff, beta);
+
+  ERL_NIF_TERM term = enif_make_resource(env, unit);
+  enif_release_resource(unit);
+  return term;
+}
+
+static ERL_NIF_TERM resample_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Resample * unit; // state pointer
+
+  // Audio rate input output
+  ErlNifBinary in_bin;
+  ERL_NIF_TERM out_term;
+
+  // Control rate ratio scale, used by variable resamplers only
+  double scale;
+
+  if (!enif_get_resource(env, argv[0],
+                         resample_type,
+                         (void**) &unit)){
+    return enif_make_badarg(env);
+  }
+
+  if(!enif_inspect_binary(env, argv[1], &in_bin)){
+    return enif_make_badarg(env);
+  }
+
+  if(!(enif_get_double(env, argv[2], &scale) &&
+       scale >= 1.0 / MAX_RATIO && scale <= MAX_RATIO)) {
+    return enif_make_badarg(env);
+  }
+
+  unsigned int taps = unit->no_of_taps;
+  unsigned int half = taps / 2;
+  unsigned int no_of_frames = in_bin.size / FRAME_SIZE;
+  // Input positions are counted from the start of the history
+  unsigned int limit = taps + no_of_frames - half;
+  const float * in = (const float *) in_bin.data;
+  const float * table = unit->table;
+  float * hist = unit->hist;
+  unsigned int n = 0;
+
+  memcpy(hist + taps, in, ((no_of_frames < taps)? no_of_frames:taps) * FRAME_SIZE);
+
+  if(unit->exact) {
+    unsigned int ipos = (unsigned int) unit->pos;
+    unsigned int iphase = unit->iphase;
+    unsigned int up = unit->up, down = unit->down;
+    // Frames while ipos + (iphase + n * down) / up < limit
+    if(ipos < limit) {
+      unsigned long long room = (unsigned long long) (limit - ipos) * up - iphase;
+      n = (room + down - 1) / down;
+    }
+    float * out = (float *) enif_make_new_binary(env, n * FRAME_SIZE, &out_term);
+    for(unsigned int i = 0; i < n; i++) {
+      out[i] = dot(window(hist, in, taps, ipos + 1 - half), table + iphase * taps, taps);
+      iphase += down;
+      ipos += iphase / up;
+      iphase %= up;
+    }
+    unit->pos = ipos - no_of_frames;
+    unit->iphase = iphase;
+  } else {
+    double pos = unit->pos;
+    double step = unit->step * scale;
+    unsigned int phases = unit->no_of_phases;
+    // Frames while (unsigned int) (pos + n * step) < limit
+    if(pos < limit) {
+      n = (unsigned int) ceil((limit - pos) / step);
+      while(n > 0 && (unsigned int) (pos + (n - 1) * step) >= limit) n--;
+      while((unsigned int) (pos + n * step) < limit) n++;
+    }
+    float * out = (float *) enif_make_new_binary(env, n * FRAME_SIZE, &out_term);
+    for(unsigned int i = 0; i < n; i++) {
+      double ppos = pos + i * step;
+      unsigned int ipos = (unsigned int) ppos;
+      float p = (ppos - ipos) * phases;
+      unsigned int ip = (unsigned int) p;
+      float a = p - ip;
+      const float * x = window(hist, in, taps, ipos + 1 - half);
+      float y0 = dot(x, table + ip * taps, taps);
+      float y1 = dot(x, table + (ip + 1) * taps, taps);
+      out[i] = y0 + a * (y1 - y0);
+    }
+    unit->pos = pos + n * step - no_of_frames;
+  }
+
+  // Keep the last taps frames of history and input
+  if(no_of_frames >= taps) {
+    memcpy(hist, in + no_of_frames - taps, taps * FRAME_SIZE);
+  } else {
+    memmove(hist, hist + no_of_frames, taps * FRAME_SIZE);
+  }
+  return out_term;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ErlNifFunc nif_funcs[] = {
+  {"resample_ctor", 4, resample_ctor},
+  {"resample_next", 3, resample_next}
+};
+
+static int open_resample_resource_type(ErlNifEnv* env)
+{
+  const char* mod = "Elixir.Granulix.Filter.Resample";
+  const char* resource_type = "resample";
+  int flags = ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER;
+  resample_type =
+    enif_open_resource_type(env, mod, resource_type,
+                            NULL, flags, NULL);
+  return ((resample_type == NULL) ? -1:0);
+}
+
+static int load(ErlNifEnv* caller_env, void** priv_data, ERL_NIF_TERM load_info)
+{
+  return open_resample_resource_type(caller_env);
+}
+
+static int upgrade(ErlNifEnv* caller_env, void** priv_data, void** old_priv_data,
+		   ERL_NIF_TERM load_info)
+{
+  return open_resample_resource_type(caller_env);
+}
+
+
+ERL_NIF_INIT(Elixir.Granulix.Filter.Resample, nif_funcs, load, NULL, upgrade, NULL);
@@ -0,0 +1,221 @@
+#include <erl_nif.h>
+#include <string.h>
+
+/* Timeline of events keyed by sample frame.
+
+   A binary heap ordered on frame (and insertion order for events on the
+   same frame). Each event term is copied into its own environment so it
+   outlives the process that scheduled it. Any process may schedule
+   events, the rendering process takes the events that fall within the
+   next period together with their frame offset into it, see
+   Granulix.Timeline.render/4. A mutex protects the queue since, unlike
+   the other resources, the timeline is meant to be shared.
+*/
+
+static ErlNifResourceType* timeline_type;
+
+typedef struct
+{
+  ErlNifUInt64 frame;
+  ErlNifUInt64 seq;
+  ErlNifEnv * env;
+  ERL_NIF_TERM term;
+} Event;
+
+typedef struct
+{
+  ErlNifMutex * mutex;
+  ErlNifUInt64 position; // First frame of the next period
+  ErlNifUInt64 seq;
+  unsigned int size, capacity;
+  Event * heap;
+} Timeline;
+
+#define INITIAL_CAPACITY 64
+
+/* ----------------------------------------------------------------------- */
+
+static inline int event_before(const Event * a, const Event * b) {
+  return (a->frame < b->frame) || (a->frame == b->frame && a->seq < b->seq);
+}
+
+static void heap_push(Timeline * unit, Event * ev) {
+  unsigned int i = unit->size++;
+  while(i > 0) {
+    unsigned int parent = (i - 1) / 2;
+    if(!event_before(ev, &unit->heap[parent])) {
+      break;
+    }
+    unit->heap[i] = unit->heap[parent];
+    i = parent;
+  }
+  unit->heap[i] = *ev;
+}
+
+static void heap_pop(Timeline * unit, Event * ev) {
+  *ev = unit->heap[0];
+  Event last = unit->heap[--unit->size];
+  unsigned int i = 0;
+  for(;;) {
+    unsigned int child = 2 * i + 1;
+    if(child >= unit->size) {
+      break;
+    }
+    if(child + 1 < unit->size && event_before(&unit->heap[child + 1], &unit->heap[child])) {
+      child++;
+    }
+    if(!event_before(&unit->heap[child], &last)) {
+      break;
+    }
+    unit->heap[i] = unit->heap[child];
+    i = child;
+  }
+  unit->heap[i] = last;
+}
+
+static void timeline_dtor(ErlNifEnv* env, void* obj)
+{
+  Timeline * unit = (Timeline *) obj;
+  for(unsigned int i = 0; i < unit->size; i++) {
+    enif_free_env(unit->heap[i].env);
+  }
+  enif_free(unit->heap);
+  enif_mutex_destroy(unit->mutex);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ERL_NIF_TERM timeline_ctor(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Timeline * unit  = enif_alloc_resource(timeline_type, sizeof(Timeline));
+  unit->mutex = enif_mutex_create("granulix_timeline");
+  unit->position = 0;
+  unit->seq = 0;
+  unit->size = 0;
+  unit->capacity = INITIAL_CAPACITY;
+  unit->heap = (Event *) enif_alloc(INITIAL_CAPACITY * sizeof(Event));
+  ERL_NIF_TERM term = enif_make_resource(env, unit);
+  enif_release_resource(unit);
+  return term;
+}
+
+static ERL_NIF_TERM timeline_schedule(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Timeline * unit;
+  Event ev;
+
+  if (!(enif_get_resource(env, argv[0], timeline_type, (void**) &unit) &&
+        enif_get_uint64(env, argv[1], &ev.frame))) {
+    return enif_make_badarg(env);
+  }
+
+  ev.env = enif_alloc_env();
+  ev.term = enif_make_copy(ev.env, argv[2]);
+
+  enif_mutex_lock(unit->mutex);
+  if(unit->size == unit->capacity) {
+    unit->capacity *= 2;
+    unit->heap = (Event *) enif_realloc(unit->heap, unit->capacity * sizeof(Event));
+  }
+  ev.seq = unit->seq++;
+  heap_push(unit, &ev);
+  enif_mutex_unlock(unit->mutex);
+
+  return enif_make_atom(env, "ok");
+}
+
+/* Returns the events before position + no_of_frames as a list of
+   {offset, event}, in time order, and moves position forward.
+   Events that are already late get offset 0. */
+static ERL_NIF_TERM timeline_next(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Timeline * unit;
+  unsigned int no_of_frames;
+  ERL_NIF_TERM list = enif_make_list(env, 0);
+  ERL_NIF_TERM result;
+  Event ev;
+
+  if (!(enif_get_resource(env, argv[0], timeline_type, (void**) &unit) &&
+        enif_get_uint(env, argv[1], &no_of_frames))) {
+    return enif_make_badarg(env);
+  }
+
+  enif_mutex_lock(unit->mutex);
+  ErlNifUInt64 start = unit->position;
+  ErlNifUInt64 end = start + no_of_frames;
+  while(unit->size > 0 && unit->heap[0].frame < end) {
+    heap_pop(unit, &ev);
+    unsigned int offset = (ev.frame < start)? 0:(unsigned int) (ev.frame - start);
+    ERL_NIF_TERM item = enif_make_tuple2(env, enif_make_uint(env, offset),
+                                         enif_make_copy(env, ev.term));
+    list = enif_make_list_cell(env, item, list);
+    enif_free_env(ev.env);
+  }
+  unit->position = end;
+  enif_mutex_unlock(unit->mutex);
+
+  enif_make_reverse_list(env, list, &result);
+  return result;
+}
+
+static ERL_NIF_TERM timeline_position(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Timeline * unit;
+  if (!enif_get_resource(env, argv[0], timeline_type, (void**) &unit)) {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(unit->mutex);
+  ErlNifUInt64 position = unit->position;
+  enif_mutex_unlock(unit->mutex);
+  return enif_make_uint64(env, position);
+}
+
+static ERL_NIF_TERM timeline_clear(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+  Timeline * unit;
+  if (!enif_get_resource(env, argv[0], timeline_type, (void**) &unit)) {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(unit->mutex);
+  for(unsigned int i = 0; i < unit->size; i++) {
+    enif_free_env(unit->heap[i].env);
+  }
+  unit->size = 0;
+  enif_mutex_unlock(unit->mutex);
+  return enif_make_atom(env, "ok");
+}
+
+/* ----------------------------------------------------------------------- */
+
+static ErlNifFunc nif_funcs[] = {
+  {"timeline_ctor", 0, timeline_ctor},
+  {"timeline_schedule", 3, timeline_schedule},
+  {"timeline_next", 2, timeline_next},
+  {"timeline_position", 1, timeline_position},
+  {"timeline_clear", 1, timeline_clear}
+};
+
+static int open_timeline_resource_type(ErlNifEnv* env)
+{
+  const char* mod = "Elixir.Granulix.Timeline";
+  const char* resource_type = "timeline";
+  int flags = ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER;
+  timeline_type =
+    enif_open_resource_type(env, mod, resource_type,
+                            timeline_dtor, flags, NULL);
+  return ((timeline_type == NULL) ? -1:0);
+}
+
+static int load(ErlNifEnv* caller_env, void** priv_data, ERL_NIF_TERM load_info)
+{
+  return open_timeline_resource_type(caller_env);
+}
+
+static int upgrade(ErlNifEnv* caller_env, void** priv_data, void** old_priv_data,
+		   ERL_NIF_TERM load_info)
+{
+  return open_timeline_resource_type(caller_env);
+}
+
+
+ERL_NIF_INIT(Elixir.Granulix.Timeline, nif_funcs, load, NULL, upgrade, NULL);
@@ -0,0 +1,130 @@
+defmodule Granulix.Analysis do
+  @moduledoc """
+  Level metering and spectrum analysis on frame binaries.
+
+  Everything is computed in the NIF (`c_src/granulix_analysis.c`)
+  without converting the frames to a list of floats, and the results are
+  small tuples or, for spectra, a binary of 32 bit floats.
+
+  Example, meter a stream and send the levels to a monitor process every
+  period while passing the frames on unchanged:
+
+      meter = Analysis.meter()
+
+      Osc.Stream.sin(440)
+      |> Analysis.tap(meter, fn levels -> send(monitor, {:levels, levels}) end)
+      |> Util.Stream.pan(0.0)
+      |> Granulix.Stream.play()
+  """
+
+  defmodule Meter do
+    @moduledoc false
+    defstruct [:ref]
+  end
+
+  defmodule Spectrum do
+    @moduledoc false
+    defstruct [:ref, :size]
+  end
+
+  @type meter() :: %Meter{ref: reference()}
+  @type spectrum() :: %Spectrum{ref: reference(), size: pos_integer()}
+  @type levels() :: {peak :: float(), rms :: float(), dc :: float()}
+  @type meter_levels() :: {peak :: float(), rms :: float(),
+                           true_peak :: float(), dc :: float()}
+
+  # -----------------------------------------------------------
+  @on_load :load_nifs
+
+  @doc false
+  def load_nifs do
+    case :erlang.load_nif(:code.priv_dir(:granulix) ++ '/granulix_analysis', 0) do
+      :ok -> :ok
+      {:error, {:reload, _}} -> :ok
+      {:error, reason} ->
+        :logger.warning('Failed to load granulix_analysis NIF: ~p',[reason])
+    end
+  end
+
+  @doc "Peak, RMS and DC offset of the frames, `{peak, rms, dc}`"
+  @spec levels(Granulix.frames()) :: levels()
+  def levels(_frames) do
+    raise "NIF levels/1 not loaded"
+  end
+
+  @doc false
+  def meter_ctor() do
+    raise "NIF meter_ctor/0 not loaded"
+  end
+
+  @doc false
+  def meter_next(_ref, _frames) do
+    raise "NIF meter_next/2 not loaded"
+  end
+
+  @doc false
+  def spectrum_ctor(_size) do
+    raise "NIF spectrum_ctor/1 not loaded"
+  end
+
+  @doc false
+  def spectrum_next(_ref, _frames) do
+    raise "NIF spectrum_next/2 not loaded"
+  end
+
+  # -----------------------------------------------------------
+
+  @spec peak(Granulix.frames()) :: float()
+  def peak(frames), do: elem(levels(frames), 0)
+
+  @spec rms(Granulix.frames()) :: float()
+  def rms(frames), do: elem(levels(frames), 1)
+
+  @spec dc(Granulix.frames()) :: float()
+  def dc(frames), do: elem(levels(frames), 2)
+
+  @doc """
+  Meter keeping the state needed for true peak, which is measured on the
+  frames oversampled 4 times.
+  """
+  @spec meter() :: meter()
+  def meter(), do: %Meter{ref: meter_ctor()}
+
+  @doc "Levels of the next frames, `{peak, rms, true_peak, dc}`"
+  @spec meter(meter(), Granulix.frames()) :: meter_levels()
+  def meter(%Meter{ref: ref}, frames), do: meter_next(ref, frames)
+
+  @doc """
+  Short-time spectrum over the last size frames, size must be a power
+  of two between 16 and 65536.
+  """
+  @spec spectrum(size :: pos_integer()) :: spectrum()
+  def spectrum(size \\ 1024), do: %Spectrum{ref: spectrum_ctor(size), size: size}
+
+  @doc """
+  Add the frames to the spectrum history and return the Hann windowed
+  magnitudes (as amplitudes) of the size / 2 + 1 bins from 0 Hz to
+  the Nyquist frequency, as a binary of 32 bit floats.
+  """
+  @spec spectrum(spectrum(), Granulix.frames()) :: binary()
+  def spectrum(%Spectrum{ref: ref}, frames), do: spectrum_next(ref, frames)
+
+  @doc "Amplitude to dBFS"
+  @spec to_db(float()) :: float()
+  def to_db(amplitude) when amplitude <= 0.0, do: -200.0
+  def to_db(amplitude), do: 20 * :math.log10(amplitude)
+
+  @doc """
+  Pass the stream through unchanged while calling fun with the result of
+  analyzing each frames binary with a meter, spectrum or the levels/1
+  function if analyzer is `:levels`.
+  """
+  @spec tap(Enumerable.t(), meter() | spectrum() | :levels, (term() -> any())) :: Enumerable.t()
+  def tap(enum, analyzer, fun) do
+    Stream.each(enum, fn frames -> fun.(analyze(analyzer, frames)) end)
+  end
+
+  defp analyze(:levels, frames), do: levels(frames)
+  defp analyze(m = %Meter{}, frames), do: meter(m, frames)
+  defp analyze(s = %Spectrum{}, frames), do: spectrum(s, frames)
+end
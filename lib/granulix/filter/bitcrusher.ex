@@ -8,6 +8,10 @@ defmodule Granulix.Filter.Bitcrusher do
   bits must be between 1.0 and 16.0
   normalized_frequency (frequency / rate) must be between 0 and 1
 
+  oversample is 1 (default), 2, 4 or 8. The quantizer is then run at that
+  many times the rate with half-band filters around it, which reduces
+  aliasing of the quantization and sample and hold steps.
+
   This module is from the [Synthex](https://github.com/bitgamma/synthex) application
   but rewritten to use NIFs. (`c_src/granulix_bitcrusher.c`)
   """
@@ -29,8 +33,8 @@ defmodule Granulix.Filter.Bitcrusher do
   end
 
   @doc false
-  def bitcrusher_ctor() do
-    raise "NIF bitcrusher_ctor/0 not loaded"
+  def bitcrusher_ctor(_oversample) do
+    raise "NIF bitcrusher_ctor/1 not loaded"
   end
 
   @doc false
@@ -39,14 +43,16 @@ defmodule Granulix.Filter.Bitcrusher do
   end
 
   # -----------------------------------------------------------
-  @spec new(bits :: integer(), normalized_frequency :: float()) :: %Bitcrusher{}
-  def new(bits, normalized_frequency) when is_integer(bits) do
-    new(bits * 1.0, normalized_frequency)
+  @spec new(bits :: integer(), normalized_frequency :: float(),
+    oversample :: 1 | 2 | 4 | 8) :: %Bitcrusher{}
+  def new(bits, normalized_frequency, oversample \\ 1)
+  def new(bits, normalized_frequency, oversample) when is_integer(bits) do
+    new(bits * 1.0, normalized_frequency, oversample)
   end
-  def new(bits, normalized_frequency) when
+  def new(bits, normalized_frequency, oversample) when
   normalized_frequency >= 0.0 and normalized_frequency <= 1.0 and
-  bits >= 1.0 and bits <= 16.0 do
-    %Bitcrusher{ref: Bitcrusher.bitcrusher_ctor(),
+  bits >= 1.0 and bits <= 16.0 and oversample in [1, 2, 4, 8] do
+    %Bitcrusher{ref: Bitcrusher.bitcrusher_ctor(oversample),
                 bits: bits,
                 normalized_frequency: normalized_frequency}
   end
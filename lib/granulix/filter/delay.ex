@@ -0,0 +1,124 @@
+defmodule Granulix.Filter.Delay do
+  alias __MODULE__
+  @behaviour SC.Plugin
+
+  @moduledoc """
+  Delay lines - plain delay, feedback comb and allpass.
+
+  The history is kept in a preallocated circular buffer in the NIF
+  resource (`c_src/granulix_delay.c`) so no frames are copied between
+  periods. Reading can be done without interpolation (`:none`), or with
+  `:linear` or `:cubic` interpolation.
+
+  max_delay is the longest delay time in seconds the unit can handle,
+  at most 1000 s.
+
+  delay is the delay time in seconds, either a number or an audio rate
+  binary of the same size as the input frames. It may also be a stream
+  of any of these when using stream/2.
+
+  feedback is the amount of the delayed signal fed back into the line
+  for comb and allpass (between -1.0 and 1.0).
+
+  Example, Karplus-Strong plucked string using a comb on a noise burst:
+
+      noise = ScP.stream(Noise.white())
+
+      Stream.concat(Envelope.saw(noise, 0.01), Envelope.empty_stream(noise))
+      |> ScP.stream(Delay.comb(0.05, 1 / 220, 0.99))
+  """
+
+  defstruct [:ref, delay: 0.0, feedback: 0.0]
+
+  # Seconds, the NIF limits the buffer to 2^28 frames
+  @max_delay 1000.0
+
+  @type interpolation() :: :none | :linear | :cubic
+  @type delay_time() :: number() | Granulix.frames()
+  @type delay() :: %Delay{ref: reference(),
+                          delay: delay_time() | Enumerable.t(),
+                          feedback: float()}
+
+  @typedoc false
+  @type delay_type :: :delay | :comb | :allpass
+
+  # -----------------------------------------------------------
+  @on_load :load_nifs
+
+  @doc false
+  def load_nifs do
+    case :erlang.load_nif(:code.priv_dir(:granulix) ++ '/granulix_delay', 0) do
+      :ok -> :ok
+      {:error, {:reload, _}} -> :ok
+      {:error, reason} ->
+        :logger.warning('Failed to load granulix_delay NIF: ~p',[reason])
+    end
+  end
+
+  @doc false
+  @spec delay_ctor(rate :: integer(), max_delay :: float(),
+    type :: delay_type(), interpolation :: interpolation()) :: reference()
+  def delay_ctor(_rate, _max_delay, _type, _interpolation) do
+    raise "NIF delay_ctor/4 not loaded"
+  end
+
+  @doc false
+  def delay_next(_ref, _frames, _delay, _feedback) do
+    raise "NIF delay_next/4 not loaded"
+  end
+
+  # -----------------------------------------------------------
+
+  @doc "Plain delay line"
+  @spec delay(max_delay :: number(), delay :: delay_time() | Enumerable.t(),
+    interpolation()) :: delay()
+  def delay(max_delay, delay, interpolation \\ :linear) do
+    new(:delay, max_delay, delay, 0.0, interpolation)
+  end
+
+  @doc "Feedback comb filter"
+  @spec comb(max_delay :: number(), delay :: delay_time() | Enumerable.t(),
+    feedback :: number(), interpolation()) :: delay()
+  def comb(max_delay, delay, feedback, interpolation \\ :linear) do
+    new(:comb, max_delay, delay, feedback, interpolation)
+  end
+
+  @doc "Schroeder allpass filter"
+  @spec allpass(max_delay :: number(), delay :: delay_time() | Enumerable.t(),
+    feedback :: number(), interpolation()) :: delay()
+  def allpass(max_delay, delay, feedback, interpolation \\ :linear) do
+    new(:allpass, max_delay, delay, feedback, interpolation)
+  end
+
+  defp new(type, max_delay, delay, feedback, interpolation) when
+  max_delay > 0 and max_delay <= @max_delay and feedback >= -1.0 and feedback <= 1.0 and
+  interpolation in [:none, :linear, :cubic] do
+    ctx = Granulix.Ctx.get()
+    %Delay{ref: delay_ctor(ctx.rate, 1.0 * max_delay, type, interpolation),
+           delay: delay,
+           feedback: 1.0 * feedback}
+  end
+
+  @impl SC.Plugin
+  def next(%Delay{ref: ref, delay: delay, feedback: fb}, frames) do
+    delay_next(ref, frames, float_or_binary(delay), fb)
+  end
+
+  @impl SC.Plugin
+  def stream(delay = %Delay{delay: delayin}, enum) do
+    cond do
+      is_number(delayin) or is_binary(delayin) ->
+        Stream.map(
+          enum,
+          fn frames -> next(delay, frames) end
+        )
+
+      true ->
+        Stream.zip(enum, delayin)
+        |> Stream.map(fn {frames, d} -> next(%{delay | delay: d}, frames) end)
+    end
+  end
+
+  defp float_or_binary(delay) when is_binary(delay), do: delay
+  defp float_or_binary(delay), do: 1.0 * delay
+end
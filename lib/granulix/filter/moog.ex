@@ -7,6 +7,10 @@ defmodule Granulix.Filter.Moog do
 
   resonance must be between 0 and 4
 
+  oversample is 1 (default), 2, 4 or 8. The ladder is then run at that
+  many times the rate with half-band filters around it, which reduces
+  aliasing at high cutoff and resonance.
+
   This module is from the [Synthex](https://github.com/bitgamma/synthex) application
   but rewritten to use NIFs. (`c_src/granulix_moog.c`)
   """
@@ -29,8 +33,8 @@ defmodule Granulix.Filter.Moog do
   end
 
   @doc false
-  def moog_ctor() do
-    raise "NIF moog_ctor/0 not loaded"
+  def moog_ctor(_oversample) do
+    raise "NIF moog_ctor/1 not loaded"
   end
 
   @doc false
@@ -39,16 +43,18 @@ defmodule Granulix.Filter.Moog do
   end
 
   # -----------------------------------------------------------
-  @spec new(cutoff :: float(), resonance :: float()) :: %Granulix.Filter.Moog{}
-  def new(cutoff, resonance) when
+  @spec new(cutoff :: float(), resonance :: float(), oversample :: 1 | 2 | 4 | 8) ::
+  %Granulix.Filter.Moog{}
+  def new(cutoff, resonance, oversample \\ 1) when
   cutoff >= 0.0 and cutoff <= 1.0 and
-  resonance >= 0.0 and resonance <= 4.0
+  resonance >= 0.0 and resonance <= 4.0 and
+  oversample in [1, 2, 4, 8]
     do
-    %Moog{ref: Moog.moog_ctor(), cutoff: cutoff, resonance: resonance}
+    %Moog{ref: Moog.moog_ctor(oversample), cutoff: cutoff, resonance: resonance}
   end
 
-  def ns(enum, cutoff, resonance) do
-    stream(new(cutoff, resonance), enum)
+  def ns(enum, cutoff, resonance, oversample \\ 1) do
+    stream(new(cutoff, resonance, oversample), enum)
   end
 
   @impl SC.Plugin
@@ -0,0 +1,111 @@
+defmodule Granulix.Filter.Resample do
+  alias __MODULE__
+  @behaviour SC.Plugin
+
+  @moduledoc """
+  Sample rate converter using polyphase windowed-sinc filters.
+
+  Converts frames at in_rate to frames at out_rate, where out_rate /
+  in_rate is between 1/64 and 64. The number of frames returned by each
+  call is whatever the input corresponds to at the new rate, e.g. 64
+  frames from a voice rendered at a quarter of the device rate becomes
+  256 frames.
+
+  quality is one of `:low` (16 taps), `:medium` (32 taps) or `:high`
+  (64 taps).
+
+  A fixed ratio resampler steps through the filter phases exactly when
+  the rates reduce to a ratio with a numerator of at most 256 (like
+  44100 -> 48000). A variable resampler takes a ratio multiplier that
+  can change every period, a number or a stream of numbers between 1/64
+  and 64, where 2.0 reads the input twice as fast. The anti-aliasing
+  cutoff is set from in_rate and out_rate, so a ratio above 1.0 will let
+  some aliasing through when downsampling.
+
+  The inner products use AVX when available (`c_src/granulix_resample.c`).
+  """
+
+  defstruct [:ref, ratio: 1.0]
+
+  # Limit of the variable ratio and of out_rate / in_rate, and the inverse
+  @max_ratio 64
+  @min_ratio 1 / 64
+
+  @type quality() :: :low | :medium | :high
+  @type resample() :: %Resample{ref: reference(), ratio: number() | Enumerable.t()}
+
+  # -----------------------------------------------------------
+  @on_load :load_nifs
+
+  @doc false
+  def load_nifs do
+    case :erlang.load_nif(:code.priv_dir(:granulix) ++ '/granulix_resample', 0) do
+      :ok -> :ok
+      {:error, {:reload, _}} -> :ok
+      {:error, reason} ->
+        :logger.warning('Failed to load granulix_resample NIF: ~p',[reason])
+    end
+  end
+
+  @doc false
+  @spec resample_ctor(in_rate :: pos_integer(), out_rate :: pos_integer(),
+    quality(), variable :: boolean()) :: reference()
+  def resample_ctor(_in_rate, _out_rate, _quality, _variable) do
+    raise "NIF resample_ctor/4 not loaded"
+  end
+
+  @doc false
+  def resample_next(_ref, _frames, _ratio) do
+    raise "NIF resample_next/3 not loaded"
+  end
+
+  # -----------------------------------------------------------
+
+  @doc "Fixed ratio converter from in_rate to out_rate"
+  @spec new(in_rate :: pos_integer(), out_rate :: pos_integer(), quality()) :: resample()
+  def new(in_rate, out_rate, quality \\ :medium) when
+  is_integer(in_rate) and in_rate > 0 and
+  is_integer(out_rate) and out_rate > 0 and
+  out_rate <= @max_ratio * in_rate and in_rate <= @max_ratio * out_rate and
+  quality in [:low, :medium, :high] do
+    %Resample{ref: resample_ctor(in_rate, out_rate, quality, false)}
+  end
+
+  @doc "Variable ratio converter, nominally from in_rate to out_rate"
+  @spec variable(in_rate :: pos_integer(), out_rate :: pos_integer(),
+    ratio :: number() | Enumerable.t(), quality()) :: resample()
+  def variable(in_rate, out_rate, ratio \\ 1.0, quality \\ :medium) when
+  is_integer(in_rate) and in_rate > 0 and
+  is_integer(out_rate) and out_rate > 0 and
+  out_rate <= @max_ratio * in_rate and in_rate <= @max_ratio * out_rate and
+  quality in [:low, :medium, :high] do
+    %Resample{ref: resample_ctor(in_rate, out_rate, quality, true), ratio: ratio}
+  end
+
+  @doc "Converter from in_rate to the rate of the current context"
+  @spec from(in_rate :: pos_integer(), quality()) :: resample()
+  def from(in_rate, quality \\ :medium) do
+    new(in_rate, Granulix.Ctx.get().rate, quality)
+  end
+
+  @impl SC.Plugin
+  def next(%Resample{ref: ref, ratio: ratio}, frames) when
+  ratio >= @min_ratio and ratio <= @max_ratio do
+    resample_next(ref, frames, 1.0 * ratio)
+  end
+
+  @impl SC.Plugin
+  def stream(resample = %Resample{ratio: ratioin}, enum) do
+    cond do
+      is_number(ratioin) ->
+        Stream.map(
+          enum,
+          fn frames -> next(resample, frames) end
+        )
+
+      true ->
+        Stream.zip(enum, ratioin)
+        |> Stream.map(fn {frames, ratio} -> next(%{resample | ratio: ratio}, frames) end)
+    end
+  end
+end
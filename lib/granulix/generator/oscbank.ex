@@ -0,0 +1,101 @@
+defmodule Granulix.Generator.OscBank do
+  alias __MODULE__
+  alias Granulix.Math, as: GM
+  @behaviour SC.Plugin
+
+  @moduledoc """
+  Bank of sine partials for additive synthesis, rendered and summed in
+  one NIF call (`c_src/granulix_oscbank.c`).
+
+  frequencies (Hz) and amplitudes are lists of floats or binaries of
+  32 bit floats, one value per partial. They can be changed between
+  calls, e.g. with a Granulix.Timeline `{:set, :amplitudes, amps}` event:
+  frequency changes keep the phase of the partials and amplitude changes
+  are ramped over the next period. Partials at or above the Nyquist
+  frequency are muted.
+
+  Example, an organ like tone with the first 8 harmonics:
+
+      OscBank.harmonic(220, [0.3, 0.2, 0.1, 0.1, 0.05, 0.05, 0.02, 0.02])
+      |> SC.Plugin.stream()
+  """
+
+  defstruct [:ref, :frequencies, :amplitudes]
+
+  @type partials() :: [number()] | binary()
+  @type oscbank() :: %OscBank{ref: reference(),
+                              frequencies: partials(),
+                              amplitudes: partials()}
+
+  # -----------------------------------------------------------
+  @on_load :load_nifs
+
+  @doc false
+  def load_nifs do
+    case :erlang.load_nif(:code.priv_dir(:granulix) ++ '/granulix_oscbank', 0) do
+      :ok -> :ok
+      {:error, {:reload, _}} -> :ok
+      {:error, reason} ->
+        :logger.warning('Failed to load granulix_oscbank NIF: ~p',[reason])
+    end
+  end
+
+  @doc false
+  def oscbank_ctor(_rate, _no_of_partials) do
+    raise "NIF oscbank_ctor/2 not loaded"
+  end
+
+  @doc false
+  def oscbank_next(_ref, _no_of_frames, _frequencies, _amplitudes) do
+    raise "NIF oscbank_next/4 not loaded"
+  end
+
+  # -----------------------------------------------------------
+
+  @spec new(frequencies :: partials(), amplitudes :: partials()) :: oscbank()
+  def new(frequencies, amplitudes) do
+    frequencies = to_binary(frequencies)
+    amplitudes = to_binary(amplitudes)
+    no_of_partials = div(byte_size(frequencies), 4)
+
+    cond do
+      no_of_partials == 0 ->
+        raise ArgumentError, "an oscillator bank needs at least one partial"
+
+      byte_size(amplitudes) != byte_size(frequencies) ->
+        raise ArgumentError,
+              "got #{no_of_partials} frequencies but #{div(byte_size(amplitudes), 4)} amplitudes"
+
+      true ->
+        :ok
+    end
+
+    ctx = Granulix.Ctx.get()
+    %OscBank{ref: oscbank_ctor(ctx.rate, no_of_partials),
+             frequencies: frequencies,
+             amplitudes: amplitudes}
+  end
+
+  @doc "Partials at multiples of the fundamental frequency"
+  @spec harmonic(fundamental :: number(), amplitudes :: [number()]) :: oscbank()
+  def harmonic(fundamental, amplitudes) when is_list(amplitudes) do
+    frequencies = for k <- 1..length(amplitudes), do: fundamental * k * 1.0
+    new(frequencies, amplitudes)
+  end
+
+  @doc "Get next no of frames"
+  @spec next(oscbank(), no_of_frames :: integer()) :: binary()
+  @impl SC.Plugin
+  def next(%OscBank{ref: ref, frequencies: f, amplitudes: a}, no_of_frames) do
+    oscbank_next(ref, no_of_frames, to_binary(f), to_binary(a))
+  end
+
+  @spec stream(oscbank(), no_of_frames :: integer()) :: Enumerable.binary()
+  @impl SC.Plugin
+  def stream(bank = %OscBank{}, no_of_frames) do
+    Stream.repeatedly(fn -> next(bank, no_of_frames) end)
+  end
+
+  defp to_binary(l) when is_list(l), do: GM.float_list_to_binary(Enum.map(l, &(&1 * 1.0)))
+  defp to_binary(bin) when is_binary(bin), do: bin
+end
@@ -2,13 +2,24 @@ defmodule Granulix.Generator.Oscillator do
   alias __MODULE__
   @behaviour SC.Plugin
 
-  defstruct [:frequency, :ref]
+  @moduledoc """
+  Sine, saw, triangle and square/pulse oscillators.
+
+  Saw, triangle and square take a bandlimited flag. When set, the
+  discontinuities of the waveform are smoothed with PolyBLEP/PolyBLAMP
+  corrections, which removes most of the aliasing heard at higher
+  frequencies. The naive waveforms are cheaper and fine for low
+  frequencies or as modulators.
+  """
+
+  defstruct [:frequency, :ref, width: 0.5]
 
   @type frequency() :: number() | Enumerable.number()
-  @type oscillator() :: %Oscillator{frequency: frequency(), ref: reference()}
+  @type oscillator() :: %Oscillator{frequency: frequency(), ref: reference(),
+                                    width: float()}
 
   @typedoc false
-  @type osc_type :: :sin | :saw | :triangle
+  @type osc_type :: :sin | :saw | :triangle | :square
 
   # -----------------------------------------------------------
   @on_load :load_nifs
@@ -25,14 +36,14 @@ defmodule Granulix.Generator.Oscillator do
   end
 
   @doc false
-  @spec osc_ctor(_rate :: integer(), _type :: osc_type()) :: reference()
-  defp osc_ctor(_rate, _type) do
-    raise "NIF osc_ctor/2 not loaded"
+  @spec osc_ctor(_rate :: integer(), _type :: osc_type(), _bandlimited :: boolean()) :: reference()
+  defp osc_ctor(_rate, _type, _bandlimited) do
+    raise "NIF osc_ctor/3 not loaded"
   end
 
   @doc false
-  defp osc_next(_ref, _freq, _no_of_frames) do
-    raise "NIF osc_next/3 not loaded"
+  defp osc_next(_ref, _freq, _no_of_frames, _width) do
+    raise "NIF osc_next/4 not loaded"
   end
 
   # -----------------------------------------------------------
@@ -40,26 +51,38 @@ defmodule Granulix.Generator.Oscillator do
   @spec sin(frequency :: frequency()) :: oscillator()
   def sin(frequency \\ 440.0) do
     ctx = Granulix.Ctx.get()
-    %Oscillator{ref: osc_ctor(ctx.rate, :sin), frequency: frequency}
+    %Oscillator{ref: osc_ctor(ctx.rate, :sin, false), frequency: frequency}
   end
 
-  @spec saw(frequency :: frequency()) :: oscillator()
-  def saw(frequency \\ 440.0) do
+  @spec saw(frequency :: frequency(), bandlimited :: boolean()) :: oscillator()
+  def saw(frequency \\ 440.0, bandlimited \\ false) do
     ctx = Granulix.Ctx.get()
-    %Oscillator{ref: osc_ctor(ctx.rate, :saw), frequency: frequency}
+    %Oscillator{ref: osc_ctor(ctx.rate, :saw, bandlimited), frequency: frequency}
   end
 
-  @spec triangle(frequency :: frequency()) :: oscillator()
-  def triangle(frequency \\ 440.0) do
+  @spec triangle(frequency :: frequency(), bandlimited :: boolean()) :: oscillator()
+  def triangle(frequency \\ 440.0, bandlimited \\ false) do
     ctx = Granulix.Ctx.get()
-    %Oscillator{ref: osc_ctor(ctx.rate, :triangle), frequency: frequency}
+    %Oscillator{ref: osc_ctor(ctx.rate, :triangle, bandlimited), frequency: frequency}
+  end
+
+  @doc """
+  Square wave, or pulse wave if the width (part of the period that is
+  high, 0 < width < 1) is not 0.5.
+  """
+  @spec square(frequency :: frequency(), width :: float(), bandlimited :: boolean()) :: oscillator()
+  def square(frequency \\ 440.0, width \\ 0.5, bandlimited \\ false)
+      when width > 0.0 and width < 1.0 do
+    ctx = Granulix.Ctx.get()
+    %Oscillator{ref: osc_ctor(ctx.rate, :square, bandlimited), frequency: frequency,
+                width: 1.0 * width}
   end
 
   @doc "Get next no of frames"
   @spec next(oscillator(), no_of_frames :: integer()) :: binary()
   @impl SC.Plugin
-  def next(%Oscillator{ref: ref, frequency: frequency}, no_of_frames) do
-    osc_next(ref, 1.0 * frequency, no_of_frames)
+  def next(%Oscillator{ref: ref, frequency: frequency, width: width}, no_of_frames) do
+    osc_next(ref, 1.0 * frequency, no_of_frames, width)
   end
 
   @spec stream(oscillator(), no_of_frames :: integer()) :: Enumerable.binary()
@@ -88,12 +111,16 @@ defmodule Granulix.Generator.Oscillator do
       Parent.stream(Parent.sin(frequency), (Granulix.Ctx.get()).period_size)
     end
 
-    def saw(frequency \\ 440.0) do
-      Parent.stream(Parent.saw(frequency), (Granulix.Ctx.get()).period_size)
+    def saw(frequency \\ 440.0, bandlimited \\ false) do
+      Parent.stream(Parent.saw(frequency, bandlimited), (Granulix.Ctx.get()).period_size)
+    end
+
+    def triangle(frequency \\ 440.0, bandlimited \\ false) do
+      Parent.stream(Parent.triangle(frequency, bandlimited), (Granulix.Ctx.get()).period_size)
     end
 
-    def triangle(frequency \\ 440.0) do
-      Parent.stream(Parent.triangle(frequency), (Granulix.Ctx.get()).period_size)
+    def square(frequency \\ 440.0, width \\ 0.5, bandlimited \\ false) do
+      Parent.stream(Parent.square(frequency, width, bandlimited), (Granulix.Ctx.get()).period_size)
     end
 
   end
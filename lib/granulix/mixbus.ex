@@ -0,0 +1,122 @@
+defmodule Granulix.MixBus do
+  alias __MODULE__
+
+  @moduledoc """
+  Mix bus that many voice processes add their frames into directly.
+
+  NIF resources are normally private to one process, but the mix bus
+  (`c_src/granulix_mixbus.c`) is made to be shared. Instead of every
+  voice sending its frames to a mixer process that folds them with
+  Granulix.Math.add/2, the voices add into per scheduler partial sums
+  in the bus and the output process takes one finished period at a time.
+
+  Only one process shall take from a bus. Voices using out/2 add one
+  period and then wait until that period has been taken before adding
+  the next one.
+
+      bus = MixBus.new(2)
+
+      for freq <- [220, 330, 440] do
+        spawn(fn ->
+          Osc.Stream.sin(freq)
+          |> Util.Stream.pan(0.0)
+          |> Util.Stream.dur(2.0)
+          |> MixBus.play(bus)
+        end)
+      end
+
+      MixBus.stream(bus)
+      |> Util.Stream.dur(2.0)
+      |> Granulix.Stream.play()
+  """
+
+  defstruct [:ref, channels: 1]
+
+  @type t() :: %MixBus{ref: reference(), channels: pos_integer()}
+
+  # -----------------------------------------------------------
+  @on_load :load_nifs
+
+  @doc false
+  def load_nifs do
+    case :erlang.load_nif(:code.priv_dir(:granulix) ++ '/granulix_mixbus', 0) do
+      :ok -> :ok
+      {:error, {:reload, _}} -> :ok
+      {:error, reason} ->
+        :logger.warning('Failed to load granulix_mixbus NIF: ~p',[reason])
+    end
+  end
+
+  @doc false
+  def mixbus_ctor(_period_size, _channels) do
+    raise "NIF mixbus_ctor/2 not loaded"
+  end
+
+  @doc false
+  def mixbus_add(_ref, _scheduler_id, _frames, _notify) do
+    raise "NIF mixbus_add/4 not loaded"
+  end
+
+  @doc false
+  def mixbus_take(_ref) do
+    raise "NIF mixbus_take/1 not loaded"
+  end
+
+  # -----------------------------------------------------------
+
+  @doc "Create a bus with up to 16 channels and the period size of the context"
+  @spec new(channels :: pos_integer()) :: t()
+  def new(channels \\ 1) when channels > 0 and channels <= 16 do
+    ctx = Granulix.Ctx.get()
+    %MixBus{ref: mixbus_ctor(ctx.period_size, channels), channels: channels}
+  end
+
+  @doc """
+  Add frames, or a list of frames for channel 1, 2..., into the open period.
+  With notify set the process gets a `{:mixbus_ready, period}` message
+  when the period has been taken.
+  """
+  @spec add(t(), Granulix.frames() | [Granulix.frames()], notify :: boolean()) :: :ok
+  def add(%MixBus{ref: ref}, frames, notify \\ false) do
+    mixbus_add(ref, :erlang.system_info(:scheduler_id), frames, notify)
+  end
+
+  @doc "Close the open period and return its frames, a list if more than one channel"
+  @spec take(t()) :: Granulix.frames() | [Granulix.frames()]
+  def take(%MixBus{ref: ref}), do: mixbus_take(ref)
+
+  @doc "Wait until the period added with notify set has been taken"
+  @spec wait_ready4more() :: :ok
+  def wait_ready4more() do
+    receive do
+      {:mixbus_ready, _period} -> :ok
+    end
+  end
+
+  @doc "Adds the stream to the bus, one period at a time. Returns the stream"
+  @spec out(Enumerable.t(), t()) :: Enumerable.t()
+  def out(enum, bus = %MixBus{}) do
+    Stream.transform(
+      enum,
+      fn -> :start end,
+      fn frames, acc ->
+        case acc do
+          :cont -> wait_ready4more()
+          :start -> :dont_wait
+        end
+
+        add(bus, frames, true)
+        {[frames], :cont}
+      end,
+      fn _acc -> :ok end
+    )
+  end
+
+  def play(enum, bus), do: out(enum, bus) |> Stream.run()
+
+  @doc "Stream of finished periods, for the output process"
+  @spec stream(t()) :: Enumerable.t()
+  def stream(bus = %MixBus{}) do
+    Stream.repeatedly(fn -> take(bus) end)
+  end
+end
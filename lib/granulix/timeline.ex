@@ -0,0 +1,171 @@
+defmodule Granulix.Timeline do
+  alias __MODULE__
+
+  @moduledoc """
+  Sample accurate event scheduling.
+
+  A timeline is a priority queue of events keyed by sample frame, kept in
+  a NIF resource (`c_src/granulix_timeline.c`). Unlike Granulix.Time.MsTime
+  and Granulix.Util.Stream.setter/2 the timing does not depend on the
+  period size or on when the Erlang scheduler gets around to run the
+  process: a unit rendered with render/4 is split at the frame offsets
+  of the events within the period and the events are applied in between.
+
+  Any process holding the timeline may schedule events, but the events are
+  consumed by the process rendering from it, so use one timeline per voice.
+
+  Events are any terms. With the default apply function `{:set, key, value}`
+  updates the key field of the unit struct, e.g. the frequency of an
+  oscillator or the cutoff of a Moog filter:
+
+      tl = Timeline.new()
+      osc = Oscillator.sin(440)
+      Timeline.schedule(tl, 0.5, {:set, :frequency, 660.0})
+      Timeline.schedule(tl, 1.0, {:set, :frequency, 880.0})
+      tl2 = Timeline.new()
+      Timeline.schedule(tl2, 0.75, {:set, :cutoff, 0.2})
+
+      Timeline.stream(tl, osc)
+      |> Timeline.transform(tl2, Moog.new(0.5, 2.0))
+      |> Util.Stream.dur(1.5)
+      |> Util.Stream.pan(0.0)
+      |> Granulix.Stream.play()
+  """
+
+  defstruct [:ref]
+
+  @type t() :: %Timeline{ref: reference()}
+  @type event() :: term()
+  @type apply_fun() :: (struct(), event() -> struct())
+
+  # -----------------------------------------------------------
+  @on_load :load_nifs
+
+  @doc false
+  def load_nifs do
+    case :erlang.load_nif(:code.priv_dir(:granulix) ++ '/granulix_timeline', 0) do
+      :ok -> :ok
+      {:error, {:reload, _}} -> :ok
+      {:error, reason} ->
+        :logger.warning('Failed to load granulix_timeline NIF: ~p',[reason])
+    end
+  end
+
+  @doc false
+  def timeline_ctor() do
+    raise "NIF timeline_ctor/0 not loaded"
+  end
+
+  @doc false
+  def timeline_schedule(_ref, _frame, _event) do
+    raise "NIF timeline_schedule/3 not loaded"
+  end
+
+  @doc false
+  def timeline_next(_ref, _no_of_frames) do
+    raise "NIF timeline_next/2 not loaded"
+  end
+
+  @doc false
+  def timeline_position(_ref) do
+    raise "NIF timeline_position/1 not loaded"
+  end
+
+  @doc false
+  def timeline_clear(_ref) do
+    raise "NIF timeline_clear/1 not loaded"
+  end
+
+  # -----------------------------------------------------------
+
+  @spec new() :: t()
+  def new(), do: %Timeline{ref: timeline_ctor()}
+
+  @doc "Schedule event at an absolute frame, counted from the first period rendered"
+  @spec at(t(), frame :: non_neg_integer(), event()) :: :ok
+  def at(%Timeline{ref: ref}, frame, event) when is_integer(frame) and frame >= 0 do
+    timeline_schedule(ref, frame, event)
+  end
+
+  @doc "Schedule event delay seconds after the start of the next period"
+  @spec schedule(t(), delay :: number(), event()) :: :ok
+  def schedule(tl = %Timeline{}, delay, event) when delay >= 0 do
+    ctx = Granulix.Ctx.get()
+    at(tl, position(tl) + round(delay * ctx.rate), event)
+  end
+
+  @doc "The first frame of the next period"
+  @spec position(t()) :: non_neg_integer()
+  def position(%Timeline{ref: ref}), do: timeline_position(ref)
+
+  @doc "Remove all scheduled events"
+  @spec clear(t()) :: :ok
+  def clear(%Timeline{ref: ref}), do: timeline_clear(ref)
+
+  @doc """
+  Take the events within the next no_of_frames frames as a list of
+  `{offset, event}` and move the timeline forward.
+  """
+  @spec events(t(), no_of_frames :: non_neg_integer()) :: [{non_neg_integer(), event()}]
+  def events(%Timeline{ref: ref}, no_of_frames), do: timeline_next(ref, no_of_frames)
+
+  @doc """
+  Render one period of unit, split at the events within the period.
+
+  input is the number of frames for a generator and the frames for a
+  filter. Returns the frames and the unit with all events applied.
+  """
+  @spec render(t(), unit :: struct(), input :: pos_integer() | Granulix.frames(), apply_fun()) ::
+  {Granulix.frames(), struct()}
+  def render(tl, unit, input, apply_event \\ &set/2) do
+    no_of_frames = if is_binary(input), do: div(byte_size(input), 4), else: input
+
+    case events(tl, no_of_frames) do
+      [] ->
+        {next(unit, input, 0, no_of_frames), unit}
+
+      events ->
+        {acc, pos, unit} =
+          Enum.reduce(events, {[], 0, unit}, fn {offset, event}, {acc, pos, unit} ->
+            acc = if offset > pos, do: [next(unit, input, pos, offset - pos) | acc], else: acc
+            {acc, max(pos, offset), apply_event.(unit, event)}
+          end)
+
+        acc = if pos < no_of_frames, do: [next(unit, input, pos, no_of_frames - pos) | acc], else: acc
+        {IO.iodata_to_binary(Enum.reverse(acc)), unit}
+    end
+  end
+
+  @doc "Generator stream rendered from the timeline"
+  @spec stream(t(), unit :: struct(), apply_fun()) :: Enumerable.t()
+  def stream(tl, unit, apply_event \\ &set/2) do
+    period_size = Granulix.Ctx.get().period_size
+    Stream.unfold(unit, fn unit -> render(tl, unit, period_size, apply_event) end)
+  end
+
+  @doc "Filter stream rendered from the timeline"
+  @spec transform(Enumerable.t(), t(), unit :: struct(), apply_fun()) :: Enumerable.t()
+  def transform(enum, tl, unit, apply_event \\ &set/2) do
+    Stream.transform(enum, unit, fn frames, unit ->
+      {out, unit} = render(tl, unit, frames, apply_event)
+      {[out], unit}
+    end)
+  end
+
+  @doc "Default apply function, handles `{:set, key, value}` events"
+  @spec set(struct(), event()) :: struct()
+  def set(unit, {:set, key, value}) do
+    case Map.has_key?(unit, key) do
+      true -> Map.put(unit, key, value)
+      false -> unit
+    end
+  end
+  def set(unit, _event), do: unit
+
+  defp next(unit, n, _pos, len) when is_integer(n) do
+    (unit.__struct__).next(unit, len)
+  end
+  defp next(unit, frames, pos, len) do
+    (unit.__struct__).next(unit, binary_part(frames, pos * 4, len * 4))
+  end
+end
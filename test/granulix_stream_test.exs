@@ -6,9 +6,12 @@ defmodule GranulixStreamTest do
   alias Granulix.Time.{MsTime, PlayTime}
   alias Granulix.Generator.Lfo
   alias Granulix.Generator.Oscillator, as: Osc
+  alias Granulix.Generator.OscBank
   alias Granulix.Generator.Noise
-  alias Granulix.Filter.{Biquad,Bitcrusher}
+  alias Granulix.Filter.{Biquad,Bitcrusher,Delay,Resample}
   alias Granulix.Envelope
+  alias Granulix.Timeline
+  alias Granulix.MixBus
   alias Granulix.Envelope.ADSR
   alias SC.Plugin, as: ScP
   alias SC.Reverb.{AnalogEcho, FreeVerb}
@@ -137,6 +140,17 @@ defmodule GranulixStreamTest do
     log_max_gauges()
   end
 
+  test "stream test band limited pulse", _context do
+    Lfo.sin(0.5) |> Lfo.nma(1000,880) # Sweep up to 1880 Hz
+    |> Osc.Stream.square(0.25, true)
+    |> m(0.2)
+    |> Util.Stream.pan(0.0)
+    |> Util.Stream.dur(4)
+    |> Granulix.Stream.play()
+
+    log_max_gauges()
+  end
+
   test "stream test lowpass", _context do
     fm = Lfo.triangle(0.25) |> Lfo.nma(400, 120)
     # You can have a stream as modulating frequency input for osc
@@ -207,6 +221,27 @@ defmodule GranulixStreamTest do
     |> Granulix.Stream.play()
   end
 
+  test "Moog oversampled", _context do
+    # High resonance near self oscillation, run at 4 times the rate
+    Osc.Stream.saw(freq(:A, 2))
+    |> Granulix.Filter.Moog.ns(0.9, 3.8, 4)
+    |> m(0.3)
+    |> Util.Stream.pan(0.0)
+    |> Util.Stream.dur(2.0)
+    |> Granulix.Stream.play()
+
+    log_max_gauges()
+  end
+
+  test "Bitcrusher oversampled", _context do
+    Osc.Stream.sin(440)
+    |> ScP.stream(Bitcrusher.new(4, 0.5, 8))
+    |> Util.Stream.dur(1.5) |> Util.Stream.pan(0.0)
+    |> Granulix.Stream.play()
+
+    log_max_gauges()
+  end
+
   test "Lag filter", _context do
     # Ramp lagtime from 0 to 1 during 5s
     lagtime = Lfo.saw(1/5) |> Lfo.nma(-1,1)
@@ -256,6 +291,96 @@ defmodule GranulixStreamTest do
     log_max_gauges()
   end
 
+  test "Karplus-Strong with comb delay", _context do
+    noise = ScP.stream(Noise.white())
+    Stream.concat(Envelope.saw(noise, 0.01), Envelope.empty_stream(noise))
+    |> ScP.stream(Delay.comb(0.05, 1 / freq(:A, 3), 0.995))
+    |> ScP.stream(Delay.delay(0.5, 0.3))
+    |> m(0.4)
+    |> Util.Stream.pan(0.0)
+    |> Util.Stream.dur(3.0)
+    |> Granulix.Stream.play()
+
+    log_max_gauges()
+  end
+
+  test "Resample voice rendered at a quarter rate", %{ctx: ctx} do
+    low_ctx = %{ctx | rate: div(ctx.rate, 4), period_size: div(ctx.period_size, 4)}
+    Granulix.Ctx.put(low_ctx)
+    osc = Osc.saw(freq(:A, 3))
+    Granulix.Ctx.put(ctx)
+
+    Osc.stream(osc, low_ctx.period_size)
+    |> ScP.stream(Resample.from(low_ctx.rate))
+    |> m(0.3)
+    |> Util.Stream.pan(0.0)
+    |> Util.Stream.dur(2.0)
+    |> Granulix.Stream.play()
+
+    log_max_gauges()
+  end
+
+  test "Resample variable ratio", %{ctx: ctx} do
+    # Read the input between 0.95 and 1.05 times as fast, 2 Hz
+    ratio = Lfo.sin(2) |> Lfo.nma(0.1, 0.95)
+    Osc.Stream.sin(freq(:A))
+    |> ScP.stream(Resample.variable(ctx.rate, ctx.rate, ratio))
+    |> m(0.4)
+    |> Util.Stream.pan(0.0)
+    |> Util.Stream.dur(2.0)
+    |> Granulix.Stream.play()
+
+    log_max_gauges()
+  end
+
+  test "Timeline sample accurate notes", _context do
+    tl = Timeline.new()
+    notes = [:C, :D, :E, :F, :G, :A, :B, :C]
+    for {note, x} <- Enum.with_index(notes) do
+      Timeline.schedule(tl, x * 0.25, {:set, :frequency, freq(note)})
+    end
+
+    Timeline.stream(tl, Osc.sin(freq(:C)))
+    |> m(0.4)
+    |> Util.Stream.pan(0.0)
+    |> Util.Stream.dur(2.0)
+    |> Granulix.Stream.play()
+
+    log_max_gauges()
+  end
+
+  test "MixBus chord", _context do
+    bus = MixBus.new(2)
+    for {note, pos} <- [{:C, -0.5}, {:E, 0.0}, {:G, 0.5}] do
+      spawn(fn ->
+        Osc.Stream.sin(freq(note))
+        |> m(0.2)
+        |> Util.Stream.pan(pos)
+        |> Util.Stream.dur(2.0)
+        |> MixBus.play(bus)
+      end)
+    end
+
+    MixBus.stream(bus)
+    |> Util.Stream.dur(2.0)
+    |> Granulix.Stream.play()
+
+    log_max_gauges()
+  end
+
+  test "OscBank bell", _context do
+    # Inharmonic partials with decaying amplitudes
+    ratios = [0.56, 0.92, 1.19, 1.71, 2.0, 2.74, 3.0, 3.76, 4.07]
+    amps = for k <- 1..length(ratios), do: 0.3 / k
+    OscBank.new(Enum.map(ratios, &(&1 * freq(:A, 3))), amps)
+    |> ScP.stream()
+    |> Envelope.saw(3.0)
+    |> Util.Stream.pan(0.0)
+    |> Granulix.Stream.play()
+
+    log_max_gauges()
+  end
+
   # test "Multicard", _context do
   #   panning = fn(c1, c2, c3, c4) ->
   #     Osc.Stream.sin(440))
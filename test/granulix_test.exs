@@ -5,6 +5,8 @@ defmodule GranulixTest do
   alias Granulix.Time.{MsTime, PlayTime}
   alias Granulix.Generator.Oscillator, as: Osc
   alias Granulix.Generator.Noise
+  alias Granulix.Filter.Resample
+  alias Granulix.Timeline
   alias SC.Plugin, as: ScP
   @docp """
   Setting up realtime scheduling policy SCHED_RR with
@@ -25,6 +27,57 @@ defmodule GranulixTest do
     assert Ma.float_list_to_binary([2.0, 4.0]) == <<0, 0, 0, 64, 0, 0, 128, 64>>
   end
 
+  test "levels" do
+    frames = Ma.float_list_to_binary([0.5, -1.0, 0.5, 0.0])
+    assert Granulix.Analysis.levels(frames) == {1.0, :math.sqrt(1.5 / 4), 0.0}
+  end
+
+  test "resample DC" do
+    for {in_rate, out_rate, n} <- [{12000, 48000, 256}, {48000, 44100, 320}] do
+      r = Resample.new(in_rate, out_rate)
+      dc = Ma.float_list_to_binary(List.duplicate(1.0, n))
+      # The first period holds the startup transient of the filter
+      _ = Resample.next(r, dc)
+
+      for _ <- 1..3 do
+        out = Ma.binary_to_float_list(Resample.next(r, dc))
+        assert length(out) == div(n * out_rate, in_rate)
+        assert Enum.all?(out, &(abs(&1 - 1.0) < 1.0e-5))
+      end
+    end
+  end
+
+  test "timeline splits at event offsets" do
+    n = 256
+    schedule = fn tl ->
+      Timeline.at(tl, 100, {:set, :frequency, 660.0})
+      Timeline.at(tl, 10, {:set, :frequency, 550.0})
+      Timeline.at(tl, n + 30, {:set, :frequency, 880.0})
+    end
+
+    tl = Timeline.new()
+    schedule.(tl)
+    assert Timeline.events(tl, n) ==
+      [{10, {:set, :frequency, 550.0}}, {100, {:set, :frequency, 660.0}}]
+    assert Timeline.events(tl, n) == [{30, {:set, :frequency, 880.0}}]
+    assert Timeline.events(tl, n) == []
+
+    tl = Timeline.new()
+    schedule.(tl)
+    {out1, osc} = Timeline.render(tl, Osc.sin(440.0), n)
+    {out2, osc} = Timeline.render(tl, osc, n)
+    assert osc.frequency == 880.0
+
+    # The same oscillator rendered segment by segment
+    ref = Osc.sin(440.0)
+    expected =
+      [{440.0, 10}, {550.0, 90}, {660.0, n - 100}, {660.0, 30}, {880.0, n - 30}]
+      |> Enum.map(fn {freq, len} -> Osc.next(%{ref | frequency: freq}, len) end)
+      |> IO.iodata_to_binary()
+
+    assert out1 <> out2 == expected
+  end
+
   test "twinkle", _context do
     dur = 0.3
     no_frames = tot_frames(dur)